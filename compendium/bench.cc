@@ -0,0 +1,227 @@
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <vector>
+
+#include "object.h"
+#include "overlap.h"
+#include "vector.h"
+
+/*
+ * Headless collision benchmark. Fills a world with N colliders laid
+ * out a few different ways, times the Collision API on each
+ * broadphase and prints the lot as JSON on stdout:
+ *
+ *   make bench && ./bench [max_n] > before.json
+ *
+ * The world grows with N so the number of neighbours per collider
+ * stays about the same, like a busier level rather than a more
+ * crowded one. Per-frame work (candidates, pairs tested, cells or
+ * nodes visited) comes from Collision::FrameStats().
+ */
+
+/* Average spacing between colliders, and their size range */
+const float kSpacing = 24.0;
+const float kMinRadius = 4.0;
+const float kMaxRadius = 8.0;
+/* How many random Check and CheckAgainst calls to time per run */
+const size_t kChecks = 100000;
+const size_t kQueries = 20000;
+/* Frames of move + Update + QueryPairs to average over */
+const int kFrames = 3;
+/* Layers, split the way game.cc splits souls and enemies */
+const unsigned kLayerA = 1 << 0;
+const unsigned kLayerB = 1 << 1;
+
+enum Distribution {
+  kUniform,
+  kClustered,
+  kRing
+};
+const char *kDistributionNames[] = { "uniform", "clustered", "ring" };
+const char *kBroadphaseNames[] = { "grid", "quadtree", "sweep_and_prune" };
+
+/*
+ * Past these sizes a run takes minutes rather than seconds: the grid
+ * and tree have a fixed number of buckets and levels, and the sweep
+ * inserts into a sorted array. Raise them to measure anyway.
+ */
+const size_t kMaxN[] = { 1 << 20, 1 << 18, 1 << 16 };
+
+class Clock {
+ public:
+  Clock() { start_ = std::chrono::steady_clock::now(); }
+  double Nanoseconds() {
+    return std::chrono::duration<double, std::nano>(
+      std::chrono::steady_clock::now() - start_
+    ).count();
+  }
+ private:
+  std::chrono::steady_clock::time_point start_;
+};
+
+/* N positions in a side x side world */
+std::vector<v2d> Scatter(Distribution dist, size_t n, float side, std::mt19937 &rng) {
+  std::uniform_real_distribution<float> unit(0.0, 1.0);
+  std::vector<v2d> out(n);
+  if (dist == kUniform) {
+    for (v2d &p : out)
+      p = { unit(rng) * side, unit(rng) * side };
+  } else if (dist == kClustered) {
+    /*
+     * Blobs of about a thousand, like souls bursting out of an enemy,
+     * a few times denser than the uniform layout
+     */
+    size_t blobs = n / 1024 + 1;
+    std::vector<v2d> centers(blobs);
+    for (v2d &c : centers)
+      c = { unit(rng) * side, unit(rng) * side };
+    std::normal_distribution<float> spread(0.0, kSpacing * 4);
+    for (v2d &p : out) {
+      v2d c = centers[rng() % blobs];
+      p = { c.x + spread(rng), c.y + spread(rng) };
+    }
+  } else {
+    /* A band along the edges, where game.cc spawns its enemies */
+    std::normal_distribution<float> band(0.0, side / 64.0);
+    for (v2d &p : out) {
+      float along = unit(rng) * side;
+      float in = std::abs(band(rng));
+      switch (rng() % 4) {
+        case 0: p = { along, in }; break;
+        case 1: p = { in, along }; break;
+        case 2: p = { along, side - in }; break;
+        default: p = { side - in, along }; break;
+      }
+    }
+  }
+  return out;
+}
+
+/* One broadphase, distribution and size; prints a JSON object */
+void Run(Collision::Broadphase mode, Distribution dist, size_t n) {
+  std::mt19937 rng(n * 3 + dist);
+  std::uniform_real_distribution<float> unit(0.0, 1.0);
+  float side = std::sqrt((float)n) * kSpacing;
+  std::vector<v2d> pos = Scatter(dist, n, side, rng);
+  /* Objects must stay put in memory once registered */
+  std::vector<Object> objs(n);
+  std::vector<Collision::Attributes> attrs(n);
+  for (size_t i = 0; i < n; ++i) {
+    objs[i].pos = pos[i];
+    Collision::Attributes &a = attrs[i];
+    /* Mostly circles with some boxes, so every kernel gets a turn */
+    float size = kMinRadius + unit(rng) * (kMaxRadius - kMinRadius);
+    if (i % 4 == 3) {
+      a.type = Collision::Attributes::AABB;
+      a.traits.w = size;
+      a.traits.h = size;
+    } else {
+      a.type = Collision::Attributes::Circle;
+      a.traits.r = size;
+    }
+    a.mask = i % 2 ? kLayerB : kLayerA;
+  }
+
+  Collision overlap(mode, { 0, 0, side, side });
+  std::vector<Collision::Handle> handles(n);
+  Clock reg;
+  for (size_t i = 0; i < n; ++i)
+    handles[i] = overlap.Register(objs[i], attrs[i]);
+  double register_ns = reg.Nanoseconds() / n;
+  overlap.Update();
+
+  /* Random pairs, mostly far apart, so this is mostly the early-out */
+  volatile size_t sink = 0;
+  Clock check;
+  for (size_t q = 0; q < kChecks; ++q)
+    sink += overlap.Check(handles[rng() % n], handles[rng() % n]);
+  double check_ns = check.Nanoseconds() / kChecks;
+
+  size_t queries = std::min(kQueries, n);
+  Clock against;
+  for (size_t q = 0; q < queries; ++q)
+    sink += overlap.CheckAgainst(handles[rng() % n], kLayerB) != nullptr;
+  double check_against_ns = against.Nanoseconds() / queries;
+
+  /* Jitter everything, then time what a game frame would do */
+  std::vector<Collision::Pair> pairs(n * 8);
+  double update_ns = 0, query_pairs_ns = 0;
+  size_t found = 0;
+  /* The Stats counters over each whole frame, Update included */
+  size_t candidates = 0, tests = 0, visited = 0;
+  for (int f = 0; f < kFrames; ++f) {
+    for (Object &o : objs)
+      o.pos += v2d(unit(rng) * 4 - 2, unit(rng) * 4 - 2);
+    Clock update;
+    overlap.Update();
+    update_ns += update.Nanoseconds();
+    Clock query;
+    found += overlap.QueryPairs(kLayerA, kLayerB, pairs.data(), pairs.size());
+    query_pairs_ns += query.Nanoseconds();
+    const Collision::Stats &frame = overlap.FrameStats();
+    candidates += frame.candidates;
+    tests += frame.tests;
+    visited += frame.visited;
+  }
+
+  /*
+   * The same colliders asking every frame while things drift slowly,
+   * where CheckAgainst gets to reuse what it found the frame before
+   */
+  double repeat_ns = 0;
+  for (int f = 0; f < kFrames; ++f) {
+    for (Object &o : objs)
+      o.pos += v2d(unit(rng) - 0.5f, unit(rng) - 0.5f);
+    overlap.Update();
+    Clock repeat;
+    for (size_t q = 0; q < queries; ++q)
+      sink += overlap.CheckAgainst(handles[q], kLayerB) != nullptr;
+    repeat_ns += repeat.Nanoseconds();
+  }
+
+  /* Unregister from the middle so the dense arrays get shuffled */
+  Clock unreg;
+  for (size_t i = 0; i < n; ++i)
+    overlap.Unregister(handles[(i * 7919) % n]);
+  double unregister_ns = unreg.Nanoseconds() / n;
+
+  printf(
+    "{\"broadphase\": \"%s\", \"distribution\": \"%s\", \"n\": %zu, "
+    "\"register_ns\": %.1f, \"unregister_ns\": %.1f, "
+    "\"check_ns\": %.1f, \"check_against_ns\": %.1f, \"repeat_check_against_ns\": %.1f, "
+    "\"update_ns\": %.0f, \"query_pairs_ns\": %.0f, \"pairs\": %zu, "
+    "\"candidates\": %zu, \"pairs_tested\": %zu, \"visited\": %zu}",
+    kBroadphaseNames[mode], kDistributionNames[dist], n,
+    register_ns, unregister_ns, check_ns, check_against_ns, repeat_ns / (queries * kFrames),
+    update_ns / kFrames, query_pairs_ns / kFrames, found / kFrames,
+    candidates / kFrames, tests / kFrames, visited / kFrames
+  );
+  fflush(stdout);
+}
+
+int main(int argc, char **argv) {
+  size_t max_n = argc > 1 ? strtoull(argv[1], nullptr, 10) : 1 << 20;
+  /* 256, 1k, 4k ... 1M */
+  std::vector<size_t> sizes;
+  for (size_t n = 256; n <= max_n; n *= 4)
+    sizes.push_back(n);
+
+  printf("{\n  \"kernels\": \"%s\",\n  \"results\": [\n", simd::Select().name);
+  bool first = true;
+  for (int mode = Collision::kGrid; mode <= Collision::kSweepAndPrune; ++mode) {
+    for (int dist = kUniform; dist <= kRing; ++dist) {
+      for (size_t n : sizes) {
+        if (n > kMaxN[mode]) continue;
+        printf(first ? "    " : ",\n    ");
+        first = false;
+        Run((Collision::Broadphase)mode, (Distribution)dist, n);
+      }
+    }
+  }
+  printf("\n  ]\n}\n");
+  return 0;
+}
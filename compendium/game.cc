@@ -2,6 +2,7 @@
 #include <cstdlib>
 #include <cmath>
 #include <string>
+#include <vector>
 
 #include "drawer.h"
 #include "input.h"
@@ -101,7 +102,14 @@ void Game::Play() {
 
   Drawer drawer;
 
-  Collision overlap;
+  /* Enemies bunch up at the spawn points and souls around the ship, so subdivide adaptively */
+  Collision overlap(Collision::kQuadtree, { 0, 0, sdl::kWindowX, sdl::kWindowY });
+  /* Soul and enemy pairs, reused every frame; grows if a frame has more */
+  std::vector<Collision::Pair> caught(512);
+#ifdef COLLISION_STATS
+  /* Debug builds (-DCOLLISION_STATS) keep about a second of collision stats; space prints them */
+  overlap.RecordStats(300);
+#endif
 
   FrameTime frame_time;
 
@@ -119,11 +127,13 @@ void Game::Play() {
  
   const unsigned kEnemyLayerMask = 1u << 0;
   const unsigned kSoulsLayerMask = 1u << 1;
+  const unsigned kBulletLayerMask = 1u << 2;
 
   /*** Bullet initialization ***/
 
   struct Bullet {
     Object obj;
+    Collision::Handle collider;
     bool is_active = true;
     
     enum State {
@@ -183,6 +193,7 @@ void Game::Play() {
   
   struct Enemy {
     Object obj;
+    Collision::Handle collider;
     bool is_active = false;
     
     /* Enemy travels along these axes */
@@ -242,6 +253,7 @@ void Game::Play() {
 
   struct Soul {
     Object obj;
+    Collision::Handle collider;
     bool is_active = false;
 
     enum State {
@@ -310,6 +322,9 @@ void Game::Play() {
 
     /* Get events from SDL's event system */
     if (sdl::GetEvents(input)) break;
+#ifdef COLLISION_STATS
+    if (input.space.pressed) overlap.DumpStats(std::cout);
+#endif
 
     /*** Update objects ***/
 
@@ -340,6 +355,12 @@ void Game::Play() {
         attr.g = 255;
         attr.b = 255;
         drawer.Register(bullet.obj, attr);
+        /* Register the bullet as a circle, to check enemies against */
+        struct Collision::Attributes col;
+        col.type = Collision::Attributes::Circle;
+        col.traits.r = 20.0;
+        col.mask = kBulletLayerMask;
+        bullet.collider = overlap.Register(bullet.obj, col);
       }
     } else if (sequence.state == Sequence::kWin) {
       /* Draw end text */
@@ -352,6 +373,9 @@ void Game::Play() {
       /* Loop on any key */
       if (input.any_was_pressed) return;
     } else if (sequence.state == Sequence::kPlay) {
+      /* Enemy the bullet ran into this frame, if any */
+      struct Enemy *bullet_struck = nullptr;
+
       /* Draw soul count */
       v2d score_pos = { 10.0, 10.0 };
       Drawer::Attributes attr;
@@ -496,7 +520,15 @@ void Game::Play() {
         if (bullet.state == Bullet::kFalling) {
           /* Bullet kinematics if it's above the "ground line" */
           float kGravity = (bullet.vel.y > 0.0) ? 4e2 : 2e2;
+          v2d bullet_from = bullet.obj.pos;
           SemiImplicitEuler(bullet.obj.pos, bullet.vel, { 0, kGravity }, dt);
+          /* Sweep along this frame's motion so fast throws can't skip over enemies */
+          float toi;
+          Collision::Attributes *struck = overlap.SweepCircle(
+            20.0, bullet_from, bullet.obj.pos, kEnemyLayerMask, toi
+          );
+          if (struck)
+            bullet_struck = (struct Enemy *)struck->data;
           if (bullet.obj.pos.y > bullet.ground) {
             soul_emitter.initial_speed = bullet.vel.Magnitude();
             bullet.state = Bullet::kGrounded;
@@ -553,9 +585,10 @@ void Game::Play() {
               enemies[e].y_axis * enemies[e].coeff * enemies[e].t * enemies[e].t;
           }
 
-          bool hit = false;
+          /* The sweep saw enemies where they were; also catch one that moved onto the bullet */
+          bool hit = bullet_struck == &enemies[e];
           if (bullet.state == Bullet::kFalling)
-            hit = overlap.CircleCircle(10.0, enemies[e].obj.pos, 20.0, bullet.obj.pos);
+            hit = hit || overlap.Check(bullet.collider, enemies[e].collider);
 
           /* handle collision with bullet */
           if (hit) {
@@ -569,7 +602,7 @@ void Game::Play() {
           if (enemies[e].elapsed > enemies[e].expiry || hit) {
             enemies[e].is_active = false;
             drawer.Unregister(enemies[e].obj);
-            overlap.Unregister(enemies[e].obj);
+            overlap.Unregister(enemies[e].collider);
           }
 
           /* Slow down on collision with a soul */
@@ -625,13 +658,14 @@ void Game::Play() {
 
           enemies[e].is_active = true;
           drawer.Register(enemies[e].obj);
-          /* register as a circle in the overlap engine */
+          /* register the same square the drawer draws */
           struct Collision::Attributes col;
-          col.type = Collision::Attributes::Circle;
-          col.traits.r = 10.0;
+          col.type = Collision::Attributes::OBB;
+          col.traits.w = 10.0;
+          col.traits.h = 10.0;
           col.mask = kEnemyLayerMask;
           col.data = &enemies[e];
-          overlap.Register(enemies[e].obj, col);
+          enemies[e].collider = overlap.Register(enemies[e].obj, col);
         }
       }
 
@@ -657,7 +691,8 @@ void Game::Play() {
         col.type = Collision::Attributes::Circle;
         col.traits.r = 10.0;
         col.mask = kSoulsLayerMask;
-        overlap.Register(souls[s].obj, col);
+        col.data = &souls[s];
+        souls[s].collider = overlap.Register(souls[s].obj, col);
       } else {
         souls[s].timer += dt;
 
@@ -701,7 +736,7 @@ void Game::Play() {
           ) {
             souls[s].is_active = false;
             drawer.Unregister(souls[s].obj);
-            overlap.Unregister(souls[s].obj);
+            overlap.Unregister(souls[s].collider);
           }
         } else if (souls[s].state == Soul::kFollowingShip) {
           
@@ -738,23 +773,6 @@ void Game::Play() {
 
         /********************************/
 
-        /* Check souls against enemies */
-        struct Enemy *enemy;
-        if (souls[s].state != Soul::kFollowingEnemy) {
-          Collision::Attributes *collision =
-            overlap.CheckAgainst(souls[s].obj, kEnemyLayerMask);
-          if (collision) {
-            enemy = (struct Enemy *)collision->data;
-            if (enemy->state == Enemy::kNormal && !enemy->caught_soul) {
-              souls[s].follow = collision->obj;
-              souls[s].enemy = enemy;
-              souls[s].enemy->caught_soul = true;
-              if (souls[s].state == Soul::kFollowingShip) --sequence.soul_count;
-              souls[s].state = Soul::kFollowingEnemy;
-            }
-          }
-        }
-
         if (souls[s].follow) {
           /* Rotate elliptically around the follow center */
           v2d follow_pos = souls[s].follow->pos;
@@ -778,12 +796,37 @@ void Game::Play() {
       }
     }
 
+    /* Let the overlap engine catch up with everything that moved */
+    overlap.Update();
+
+    /* Check souls against enemies */
+    size_t caught_count;
+    /* A full buffer may have left pairs out; ask again with room for them */
+    while ((caught_count = overlap.QueryPairs(
+      kSoulsLayerMask, kEnemyLayerMask, caught.data(), caught.size()
+    )) == caught.size())
+      caught.resize(caught.size() * 2);
+    for (size_t p = 0; p < caught_count; ++p) {
+      struct Soul *soul = (struct Soul *)caught[p].a->data;
+      struct Enemy *enemy = (struct Enemy *)caught[p].b->data;
+      if (soul->state == Soul::kFollowingEnemy)
+        continue;
+      if (enemy->state == Enemy::kNormal && !enemy->caught_soul) {
+        soul->follow = caught[p].b->obj;
+        soul->enemy = enemy;
+        soul->enemy->caught_soul = true;
+        if (soul->state == Soul::kFollowingShip) --sequence.soul_count;
+        soul->state = Soul::kFollowingEnemy;
+      }
+    }
+
     /**********************/
 
     /* Clear transient state for buttons */
     input.AtFrameEnd();
 
-    /* Draw all the objects */
+    /* Draw all the objects; the title and end screens hardly change */
+    drawer.SetRetained(sequence.state != Sequence::kPlay);
     drawer.Draw();
 
     /* Drawer shouldn't clear transient objects (for now, lines) if game in hitstop */
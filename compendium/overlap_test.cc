@@ -0,0 +1,119 @@
+#include <cstdio>
+#include <vector>
+
+#include "object.h"
+#include "overlap.h"
+#include "vector.h"
+
+/*
+ * Checks for broadphase bookkeeping that once went wrong. Exits non
+ * zero if any fails:
+ *
+ *   make test
+ */
+
+int failures = 0;
+
+void Expect(bool ok, const char *what, int mode) {
+  if (ok) return;
+  printf("FAIL %s (broadphase %d)\n", what, mode);
+  ++failures;
+}
+
+/* Everything in mask, by asking for a radius bigger than the world */
+size_t CountAll(Collision &overlap, unsigned mask) {
+  static Collision::Nearby out[256];
+  return overlap.QueryRadius({ 512, 512 }, 4096, mask, out, 256);
+}
+
+/*
+ * A box whose left edge lands on the quadtree's middle split, where
+ * the rect rebuilt from centre and half-size comes out an ulp left of
+ * the one computed from position and half-size. The broadphase has to
+ * be able to find what it was given, or moving and unregistering the
+ * box leave copies of it behind.
+ */
+void SplitBoundary(Collision::Broadphase mode) {
+  Collision overlap(mode, { 0, 0, 1024, 1024 });
+  /* Enough colliders to make the root split */
+  std::vector<Object> filler(40);
+  for (size_t i = 0; i < filler.size(); ++i) {
+    filler[i].pos = { 40.0f + (i % 8) * 120, 40.0f + (i / 8) * 120 };
+    Collision::Attributes a;
+    a.type = Collision::Attributes::Circle;
+    a.traits.r = 4;
+    overlap.Register(filler[i], a);
+  }
+  Object box;
+  box.pos = { 700, 700 };
+  Collision::Attributes a;
+  a.type = Collision::Attributes::AABB;
+  a.traits.w = 29.3972473;
+  a.traits.h = 29.3972473;
+  Collision::Handle h = overlap.Register(box, a);
+  overlap.Update();
+
+  size_t live = filler.size() + 1;
+  const v2d stops[] = { { 541.397278, 700 }, { 541.397278, 300 }, { 800, 300 } };
+  for (v2d p : stops) {
+    box.pos = p;
+    overlap.Update();
+    Expect(CountAll(overlap, ~0u) == live, "moved box found once", mode);
+  }
+  box.pos = { 541.397278, 541.397278 };
+  overlap.Update();
+  overlap.Unregister(h);
+  Expect(CountAll(overlap, ~0u) == live - 1, "unregistered box gone", mode);
+}
+
+/* Two cells of one collider can land in the same grid bucket */
+void SharedBucket(Collision::Broadphase mode) {
+  Collision overlap(mode, { 0, 0, 1024, 1024 });
+  Object a, b;
+  a.pos = { 768, 96 };
+  b.pos = { 768, 96 };
+  Collision::Attributes circle;
+  circle.type = Collision::Attributes::Circle;
+  circle.traits.r = 10;
+  circle.mask = 1;
+  Collision::Attributes box;
+  box.type = Collision::Attributes::AABB;
+  box.traits.w = 10;
+  box.traits.h = 10;
+  box.mask = 2;
+  overlap.Register(a, circle);
+  overlap.Register(b, box);
+  overlap.Update();
+  Collision::Pair pairs[4];
+  Expect(overlap.QueryPairs(1, 2, pairs, 4) == 1, "one pair", mode);
+  Expect(CountAll(overlap, 3) == 2, "each collider once", mode);
+}
+
+/*
+ * Two colliders on a diagonal. The search circle has to grow past the
+ * farthest corner of everything indexed, not just its farthest side.
+ */
+void NearestOnDiagonal(Collision::Broadphase mode) {
+  Collision overlap(mode, { 0, 0, 1024, 1024 });
+  Object a, b;
+  a.pos = { 0, 0 };
+  b.pos = { 100, 100 };
+  Collision::Attributes circle;
+  circle.type = Collision::Attributes::Circle;
+  circle.traits.r = 1;
+  overlap.Register(a, circle);
+  overlap.Register(b, circle);
+  overlap.Update();
+  Collision::Nearby out[2];
+  Expect(overlap.QueryNearest({ 0, 0 }, 2, ~0u, out) == 2, "both nearest found", mode);
+}
+
+int main() {
+  for (int mode = Collision::kGrid; mode <= Collision::kSweepAndPrune; ++mode) {
+    SplitBoundary((Collision::Broadphase)mode);
+    SharedBucket((Collision::Broadphase)mode);
+    NearestOnDiagonal((Collision::Broadphase)mode);
+  }
+  if (!failures) printf("ok\n");
+  return failures != 0;
+}
@@ -0,0 +1,69 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <memory>
+#include <new>
+#include <utility>
+#include <vector>
+
+/*
+ * Linear allocator for things that all go away at once, like one
+ * frame's worth of draw requests. Allocating bumps an offset through
+ * a chain of blocks, and Reset() rewinds to the first block in O(1)
+ * without freeing any, so once the chain has grown to fit a typical
+ * frame nothing more comes from the heap. Nothing in it is ever
+ * destroyed, so only put trivially destructible things in it.
+ */
+class Arena {
+ public:
+  explicit Arena(size_t block_size = kBlockSize) : block_size_(block_size) {}
+
+  /* size bytes aligned to align, which must be a power of two */
+  void *Allocate(size_t size, size_t align) {
+    for (; block_ < blocks_.size(); ++block_, used_ = 0) {
+      struct Block &b = blocks_[block_];
+      size_t at = (used_ + align - 1) & ~(align - 1);
+      if (at + size <= b.size) {
+        used_ = at + size;
+        return b.data.get() + at;
+      }
+    }
+    /* Out of blocks; add one, big enough for this even if it's huge */
+    size_t size_of_block = std::max(block_size_, size + align);
+    blocks_.push_back({ std::unique_ptr<char[]>(new char[size_of_block]), size_of_block });
+    return Allocate(size, align);
+  }
+  template <typename T, typename... Args>
+  T *New(Args &&...args) {
+    return new (Allocate(sizeof(T), alignof(T))) T{ std::forward<Args>(args)... };
+  }
+  /* A copy of n bytes starting at s */
+  const char *Copy(const char *s, size_t n) {
+    char *to = (char *)Allocate(n, 1);
+    memcpy(to, s, n);
+    return to;
+  }
+  /* Forget everything allocated so far, keeping the blocks */
+  void Reset() {
+    block_ = 0;
+    used_ = 0;
+  }
+
+ private:
+  static const size_t kBlockSize = 64 << 10;
+
+  struct Block {
+    std::unique_ptr<char[]> data;
+    size_t size;
+  };
+  std::vector<struct Block> blocks_;
+  size_t block_size_;
+  /* Bump position: block index and offset into it */
+  size_t block_ = 0;
+  size_t used_ = 0;
+}; // class Arena
+
+#endif
@@ -1,48 +1,78 @@
 #ifndef DRAWER_H
 #define DRAWER_H
 
+#include <algorithm>
+#include <cstring>
 #include <iostream>
+#include <list>
+#include <string_view>
 #include <vector>
 #include <unordered_map>
 
+#include "arena.h"
 #include "input.h"
 #include "object.h"
+#include "packer.h"
 #include "sdl.h"
 
 class Drawer {
  public:
+  /* An image, usually sharing an atlas texture with others */
   struct Texture {
-    SDL_Texture *ptr;
+    SDL_Texture *ptr = nullptr;
+    /* Size in pixels, to turn pixel offsets into texture coordinates */
+    float w = 0;
+    float h = 0;
+    /* Where the image is in the texture, in pixels */
+    SDL_Rect src = { 0, 0, 0, 0 };
+    /* Small number standing in for the texture in draw order keys */
+    unsigned id = 0;
   };
 
-  // struct Sprite {
-  //   struct Texture texture;
-  //   v2d off;
-  //   float w;
-  //   float h;
-  //   float theta;
-  // };
-  // void SetSprite(Object &o, std::string filename) {
-  //   size_t hash = std::hash<std::string>{}(filename);
+  /*
+   * Drawn centred on the object and turned theta degrees clockwise.
+   * off and w, h pick out part of the image, in pixels from its top
+   * left, for sprite sheets; SetSprite makes it the whole image.
+   */
+  struct Sprite {
+    struct Texture texture;
+    v2d off;
+    float w = 0;
+    float h = 0;
+    float theta = 0;
+  };
+  void SetSprite(Object &o, std::string filename) {
+    size_t hash = std::hash<std::string>{}(filename);
 
-  //   if (textures_.find(hash) == textures_.end())
-  //     LoadTexture(filename, hash);
+    if (textures_.find(hash) == textures_.end())
+      LoadTexture(filename, hash);
 
-  //   if (map_.find(o.key) == map_.end()) return;
+    if (map_.find(o.key) == map_.end()) return;
     
-  //   map_[o.key].type = Attributes::kSprite;
-  //   map_[o.key].sprite.texture = textures_[hash];
-  // }
-  // Sprite *GetSprite(Object &o) {
-  //   if (map_.find(o.key) == map_.end()) return nullptr;
-  //   return &map_[o.key].sprite;
-  // }
+    struct Sprite &sprite = map_[o.key].sprite;
+    map_[o.key].type = Attributes::kSprite;
+    sprite.texture = textures_[hash];
+    sprite.off = { 0, 0 };
+    sprite.w = sprite.texture.src.w;
+    sprite.h = sprite.texture.src.h;
+  }
+  Sprite *GetSprite(Object &o) {
+    if (map_.find(o.key) == map_.end()) return nullptr;
+    return &map_[o.key].sprite;
+  }
 
+  /* Where a character sits in its font's texture, in texture coordinates */
+  struct Glyph {
+    bool defined = false;
+    v2d uv0;
+    v2d uv1;
+  };
   struct Font {
     float w;
     float h;
     struct Texture texture;
-    std::unordered_map<char, v2d> char_to_offset;
+    /* Indexed by unsigned char; characters not in the charmap draw nothing */
+    struct Glyph glyphs[256];
   };
   template <size_t R, size_t C>
   void LoadFont(
@@ -67,12 +97,16 @@ class Drawer {
     fonts_[nhash].h = height;
     Font &f = fonts_[nhash];
     
+    /* Bake each cell into texture coordinates once, here */
+    if (f.texture.w == 0 || f.texture.h == 0) return;
+    float x = f.texture.src.x, y = f.texture.src.y;
     for (size_t _r = 0; _r < R; ++_r)
-      for (size_t _c = 0; _c < C; ++_c)
-        f.char_to_offset[charmap[_r][_c]] = v2d(
-          _c * f.w,
-          _r * f.h
-        );
+      for (size_t _c = 0; _c < C; ++_c) {
+        struct Glyph &g = f.glyphs[(unsigned char)charmap[_r][_c]];
+        g.defined = true;
+        g.uv0 = v2d((x + _c * f.w) / f.texture.w, (y + _r * f.h) / f.texture.h);
+        g.uv1 = v2d((x + (_c + 1) * f.w) / f.texture.w, (y + (_r + 1) * f.h) / f.texture.h);
+      }
   }
 
 
@@ -85,28 +119,40 @@ class Drawer {
     enum Type {
       kPrimitive,
       kSprite
-    } type;
-    // struct Sprite sprite;
+    } type = kPrimitive;
+    struct Sprite sprite;
     /**
      * Use a vector for rotation when drawing lines
      */
     v2d point_at = { 1.0, 0.0 };
+    /* Higher layers are drawn over lower ones */
+    uint8_t layer = 0;
+    /* How lines and primitives mix with what's under them; text always blends */
+    SDL_BlendMode blend = SDL_BLENDMODE_NONE;
     /* Pointer back to the object */
     Object *obj = nullptr;
+    /* Set by Register; breaks ties in the draw order */
+    uint32_t sequence = 0;
   };
 
   Drawer() {
     map_.reserve(512);
-    lines_.reserve(512);
+  }
+  ~Drawer() {
+    for (auto &[_, cached] : text_cache_)
+      SDL_DestroyTexture(cached.texture.ptr);
+    for (struct Page &page : pages_)
+      SDL_DestroyTexture(page.texture.ptr);
+    if (canvas_) SDL_DestroyTexture(canvas_);
   }
   /* Default register */
   void Register(Object &object) {
-    map_[object.key] = Attributes();
-    map_[object.key].obj = &object;
+    Register(object, Attributes());
   }
   void Register(Object &object, struct Attributes attr) {
     map_[object.key] = attr;
     map_[object.key].obj = &object;
+    map_[object.key].sequence = registered_++;
   }
   void Unregister(Object &object) {
     if (map_.find(object.key) == map_.end()) return;
@@ -124,88 +170,575 @@ class Drawer {
     if (map_.find(o.key) == map_.end()) return;
     map_[o.key].point_at = dir;
   }
+  /*
+   * What part of the world the window shows: offset is the world
+   * position at its top left, and zoom how many pixels one unit of
+   * world covers. Objects, lines and rays go through the camera;
+   * text is placed in window pixels and stays put.
+   */
+  struct Camera {
+    v2d offset = { 0.0, 0.0 };
+    float zoom = 1.0;
+  };
+  void SetCamera(const struct Camera &camera) {
+    camera_ = camera;
+  }
+  const struct Camera &GetCamera() const {
+    return camera_;
+  }
+  /*
+   * In retained mode the frame is drawn into a canvas texture that's
+   * kept between Draw() calls, and each frame only the parts of it
+   * where something appeared, went away or changed are drawn again.
+   * A frame where nothing changed draws nothing at all. Worth it when
+   * most of the screen sits still; off by default.
+   */
+  void SetRetained(bool retained) {
+    if (retained == retained_) return;
+    retained_ = retained;
+    stale_ = true;
+  }
+  /* Window position of a world position, and the other way round */
+  v2d ToScreen(v2d world) const {
+    return (world - camera_.offset) * camera_.zoom;
+  }
+  v2d ToWorld(v2d screen) const {
+    return screen / camera_.zoom + camera_.offset;
+  }
   void ClearTransient() {
-    lines_.clear();
-    texts_.clear();
+    arena_.Reset();
+    lines_ = List<struct TransientLine>();
+    texts_ = List<struct TransientText>();
   }
+  /*
+   * Everything is recorded as a command with a sort key of layer,
+   * texture, blend mode and colour, and drawn in key order. Equal
+   * keys go lines, then objects, then text, each in the order they
+   * were added or registered, so a frame always comes out the same.
+   * Consecutive commands with the same texture and blend mode share
+   * one SDL_RenderGeometry call; images all live in a few atlas
+   * textures, so sprites from one of them go out together.
+   *
+   * Objects and lines entirely outside the camera's view are dropped
+   * before they get a command. That is a bounds check per object, not
+   * a spatial index: objects move by having their pos written to, so
+   * an index would have to be rebuilt every frame to be trusted, which
+   * is the same walk with more work on top.
+   */
   void Draw() {
-    sdl::StartDraw();
-    for (const LineAttributes &l : lines_) {
-      sdl::SetColor(l.attr.r, l.attr.g, l.attr.b);
-      sdl::DrawLine(l.pos, l.vec, l.nub);
-    }
+    /* Render targets have to be filled before the frame starts */
+    ++draws_;
+    for (struct TransientText *t = texts_.first; t; t = t->next)
+      t->cached = CacheText(*t);
+    commands_.clear();
+    view_min_ = camera_.offset;
+    view_max_ = ToWorld({ (float)sdl::kWindowX, (float)sdl::kWindowY });
+    uint32_t i = 0;
+    for (const struct TransientLine *l = lines_.first; l; ++i, l = l->next)
+      if (Visible(*l))
+        Record(Command::kLine, i, l->layer, l->color, nullptr, l->blend, l);
     for (const auto &[_, attr] : map_) {
-      if (!attr.enabled) continue;
-      if (attr.type == Attributes::kPrimitive) {
-        sdl::SetColor(attr.r, attr.g, attr.b);
-        sdl::DrawRect(attr.obj->pos, attr.size, attr.point_at);
-      }
-      if (attr.type == Attributes::kSprite) {
-        sdl::SetColor(attr.r, attr.g, attr.b);
-        // sdl::DrawTexture(attr.sprite.texture.ptr, attr.obj->pos, attr.sprite.off, attr.sprite.h, attr.sprite.w, attr.sprite.theta);
-      }
+      if (!attr.enabled || !Visible(attr)) continue;
+      if (attr.type == Attributes::kPrimitive)
+        Record(Command::kRect, attr.sequence, attr.layer, Color(attr), nullptr, attr.blend, &attr);
+      if (attr.type == Attributes::kSprite && attr.sprite.texture.ptr)
+        Record(Command::kSprite, attr.sequence, attr.layer, Color(attr), &attr.sprite.texture, SDL_BLENDMODE_BLEND, &attr);
     }
-    for (const TextAttributes &t : texts_) {
-      struct Font *f = t.fontp;
-      sdl::SetColor(t.attr.r, t.attr.g, t.attr.b);
-      for (size_t c = 0; c < t.text.size(); ++c) {
-        v2d dest;
-        dest.x = t.pos.x + c * f->w;
-        dest.y = t.pos.y;
-        sdl::DrawTexture(
-          f->texture.ptr,
-          dest,
-          f->char_to_offset[t.text[c]],
-          f->h,
-          f->w,
-          0
-        );
-      }
+    i = 0;
+    for (const struct TransientText *t = texts_.first; t; t = t->next) {
+      const struct Texture *texture = t->cached ? t->cached : &t->fontp->texture;
+      Record(Command::kText, i++, t->layer, t->color, texture, SDL_BLENDMODE_BLEND, t);
     }
+    std::sort(commands_.begin(), commands_.end(), [](const Command &l, const Command &r) {
+      if (l.key != r.key) return l.key < r.key;
+      if (l.kind != r.kind) return l.kind < r.kind;
+      return l.sequence < r.sequence;
+    });
+    if (retained_ && DrawRetained()) return;
+    sdl::StartDraw();
+    Submit(nullptr);
     sdl::EndDraw();
   }
-  void Ray(v2d pos, v2d ray, struct Attributes attr) {
-    lines_.push_back({ pos, ray, true, attr });
+  /* Lines, rays and text last until ClearTransient() */
+  void Ray(v2d pos, v2d ray, const struct Attributes &attr) {
+    lines_.Add(arena_.New<struct TransientLine>(
+      pos, ray, Color(attr), attr.blend, attr.layer, true
+    ));
   }
-  void Line(v2d pos, v2d vec, struct Attributes attr) {
-    lines_.push_back({ pos, vec, false, attr });
+  void Line(v2d pos, v2d vec, const struct Attributes &attr) {
+    lines_.Add(arena_.New<struct TransientLine>(
+      pos, vec, Color(attr), attr.blend, attr.layer, false
+    ));
   }
-  void Text(v2d pos, std::string font, std::string text, struct Attributes attr) {
-    size_t nhash = std::hash<std::string>{}(font);
-    if (fonts_.find(nhash) == fonts_.end()) return;
-    v2d dim; /* placeholder var for text box dimensions */
-    texts_.push_back({ pos, dim, text, &fonts_[nhash], attr });
+  /* Views, so string literals don't become a std::string each call; same hash as LoadFont's */
+  void Text(v2d pos, std::string_view font, std::string_view text, const struct Attributes &attr) {
+    auto it = fonts_.find(std::hash<std::string_view>{}(font));
+    if (it == fonts_.end()) return;
+    struct Font *f = &it->second;
+    v2d dim = { f->w * text.size(), f->h };
+    const char *bytes = arena_.Copy(text.data(), text.size());
+    texts_.Add(arena_.New<struct TransientText>(
+      pos, dim, bytes, text.size(), f, Color(attr), attr.layer
+    ));
   }
  private:
   std::unordered_map<size_t, struct Attributes> map_;
   
-  struct LineAttributes {
+  /*
+   * Transient lines and text live in arena_ until ClearTransient(),
+   * with just what drawing them needs, each list in the order added
+   */
+  Arena arena_;
+  template <typename T>
+  struct List {
+    T *first = nullptr;
+    T *last = nullptr;
+    void Add(T *item) {
+      (last ? last->next : first) = item;
+      last = item;
+    }
+  };
+  struct TransientLine {
     v2d pos;
     v2d vec;
+    SDL_Color color;
+    SDL_BlendMode blend;
+    uint8_t layer;
     bool nub;
-    struct Attributes attr;
+    struct TransientLine *next = nullptr;
   };
-  std::vector<struct LineAttributes> lines_;
+  List<struct TransientLine> lines_;
 
   std::unordered_map<size_t, struct Font> fonts_;
-  struct TextAttributes {
+  struct TransientText {
     v2d pos;
     v2d dim;
-    std::string text;
+    /* Copied into the arena; not null terminated */
+    const char *text;
+    size_t length;
     struct Font *fontp;
-    struct Attributes attr;
+    SDL_Color color;
+    uint8_t layer;
+    /* Pre-rendered copy from the text cache, if it has one this frame */
+    const struct Texture *cached = nullptr;
+    struct TransientText *next = nullptr;
   };
-  std::vector<struct TextAttributes> texts_;
+  List<struct TransientText> texts_;
 
+  /*
+   * Loaded images, packed into kAtlasSize square pages as they load.
+   * A new page is started when none has room, and an image too big
+   * for a page gets a page of its own, sized to fit.
+   */
+  static constexpr int kAtlasSize = 1024;
+  /* Clear pixels right of and below each image, so neighbours don't bleed */
+  static constexpr int kAtlasPadding = 1;
+  struct Page {
+    struct Texture texture;
+    ShelfPacker packer;
+  };
+  std::vector<struct Page> pages_;
   std::unordered_map<size_t, struct Texture> textures_;
   void LoadTexture(std::string filename, size_t hash) {
     struct Texture nt;
-    nt.ptr = sdl::LoadTexture(filename);
-    if (!nt.ptr) {
+    SDL_Surface *surf = sdl::LoadSurface(filename);
+    if (!surf) {
       /* On error: Use a default sprite? */
+      textures_[hash] = nt;
+      return;
+    }
+    int x, y;
+    struct Page *page = nullptr;
+    for (struct Page &p : pages_)
+      if (p.packer.Pack(surf->w, surf->h, x, y)) {
+        page = &p;
+        break;
+      }
+    if (!page) {
+      /* Big images get a page that fits them, padding and all */
+      int size = std::max({ kAtlasSize, surf->w + kAtlasPadding, surf->h + kAtlasPadding });
+      struct Page p = { {}, ShelfPacker(size, kAtlasPadding) };
+      p.texture.ptr = sdl::CreateAtlas(size, size);
+      p.texture.w = size;
+      p.texture.h = size;
+      p.texture.src = { 0, 0, size, size };
+      p.texture.id = next_texture_id_++;
+      if (p.texture.ptr && p.packer.Pack(surf->w, surf->h, x, y)) {
+        pages_.push_back(p);
+        page = &pages_.back();
+      }
+    }
+    if (page) {
+      sdl::CopySurface(page->texture.ptr, surf, x, y);
+      nt = page->texture;
+      nt.src = { x, y, surf->w, surf->h };
     }
+    SDL_FreeSurface(surf);
     textures_[hash] = nt;
   }
+
+  /* Hands out Attributes::sequence */
+  uint32_t registered_ = 0;
+
+  struct Camera camera_;
+  /* The world rectangle in view, worked out at the start of Draw() */
+  v2d view_min_;
+  v2d view_max_;
+  bool Visible(v2d min, v2d max) const {
+    return
+      max.x >= view_min_.x && min.x <= view_max_.x &&
+      max.y >= view_min_.y && min.y <= view_max_.y;
+  }
+  /* Whether any of it could land in the window, outlines and all */
+  bool Visible(const struct TransientLine &l) const {
+    /* A diagonal ray's nub tip reaches kNibLength * sqrt(2) on one axis */
+    const float kRoot2 = 1.41421356;
+    float pad = (l.nub ? sdl::kNibLength * kRoot2 : 1.0) / camera_.zoom;
+    v2d end = { l.pos.x + l.vec.x, l.pos.y + l.vec.y };
+    return Visible(
+      { std::min(l.pos.x, end.x) - pad, std::min(l.pos.y, end.y) - pad },
+      { std::max(l.pos.x, end.x) + pad, std::max(l.pos.y, end.y) + pad }
+    );
+  }
+  bool Visible(const struct Attributes &attr) const {
+    const float kRoot2 = 1.41421356;
+    /* Half the diagonal covers any rotation */
+    float reach = attr.type == Attributes::kSprite
+      ? std::hypot(attr.sprite.w, attr.sprite.h) / 2
+      : attr.size / 2 * kRoot2;
+    reach += 1.0 / camera_.zoom;
+    v2d pos = attr.obj->pos;
+    return Visible({ pos.x - reach, pos.y - reach }, { pos.x + reach, pos.y + reach });
+  }
+
+  /*
+   * One thing to draw. key packs layer, texture id, blend mode and
+   * colour, most significant first. sequence is the line or text
+   * index, or the object's registration number. item is the
+   * TransientLine, Attributes (for rects and sprites) or
+   * TransientText, going by kind.
+   */
+  struct Command {
+    uint64_t key;
+    enum Kind : uint8_t {
+      kLine,
+      kRect,
+      kSprite,
+      kText
+    } kind;
+    uint32_t sequence;
+    SDL_BlendMode blend;
+    SDL_Texture *texture;
+    const void *item;
+  };
+  std::vector<struct Command> commands_;
+  /* Triangles waiting for a texture or blend mode change, or the end of Draw() */
+  sdl::Batch batch_;
+
+  void Record(
+    Command::Kind kind, uint32_t sequence, uint8_t layer, SDL_Color color,
+    const struct Texture *texture, SDL_BlendMode blend, const void *item
+  ) {
+    uint64_t key =
+      (uint64_t)layer << 56 |
+      (uint64_t)(texture ? texture->id & 0xffff : 0) << 40 |
+      (uint64_t)(blend & 0xff) << 32 |
+      (uint64_t)color.r << 16 | (uint64_t)color.g << 8 | color.b;
+    commands_.push_back({ key, kind, sequence, blend, texture ? texture->ptr : nullptr, item });
+  }
+  /* Batch and draw the commands, or only those touching clip if it's set */
+  void Submit(const SDL_Rect *clip) {
+    batch_.Clear();
+    for (size_t i = 0; i < commands_.size(); ++i) {
+      const Command &c = commands_[i];
+      if (clip && !SDL_HasIntersection(&marks_[i].bounds, clip)) continue;
+      if (c.texture != batch_.texture || c.blend != batch_.blend) {
+        sdl::DrawBatch(batch_);
+        batch_.Clear();
+        batch_.texture = c.texture;
+        batch_.blend = c.blend;
+      }
+      if (c.kind == Command::kLine) {
+        const struct TransientLine &l = *(const struct TransientLine *)c.item;
+        sdl::BatchLine(batch_, ToScreen(l.pos), l.vec * camera_.zoom, l.nub, l.color);
+      } else if (c.kind == Command::kRect) {
+        const struct Attributes &attr = *(const struct Attributes *)c.item;
+        sdl::BatchRect(
+          batch_, ToScreen(attr.obj->pos), attr.size * camera_.zoom, attr.point_at, Color(attr)
+        );
+      } else if (c.kind == Command::kSprite) {
+        const struct Attributes &attr = *(const struct Attributes *)c.item;
+        const struct Sprite &s = attr.sprite;
+        v2d centre = ToScreen(attr.obj->pos);
+        float zoom = camera_.zoom;
+        v2d corner = { centre.x - s.w * zoom / 2, centre.y - s.h * zoom / 2 };
+        v2d source = { s.texture.src.x + s.off.x, s.texture.src.y + s.off.y };
+        sdl::BatchTexture(
+          batch_, corner, source, s.h, s.w, s.texture.w, s.texture.h, Color(attr), s.theta, zoom
+        );
+      } else {
+        const struct TransientText &t = *(const struct TransientText *)c.item;
+        if (t.cached)
+          sdl::BatchTexture(batch_, t.pos, { 0, 0 }, t.dim.y, t.dim.x, t.dim.x, t.dim.y, kWhite);
+        else
+          BatchText(t, t.pos, t.color);
+      }
+    }
+    sdl::DrawBatch(batch_);
+  }
+
+  /*
+   * Retained mode. Each command gets a mark: a hash of everything that
+   * decides its pixels, and the window rectangle they fall in. Marks
+   * from this frame and the last, sorted by hash, are walked side by
+   * side; the rectangles of marks only one frame has are dirty. Each
+   * dirty rectangle is cleared on the canvas and everything touching
+   * it drawn again, in the usual order, clipped to it.
+   */
+  static const size_t kMaxDirtyRects = 16;
+  struct Mark {
+    uint64_t hash;
+    SDL_Rect bounds;
+  };
+  bool retained_ = false;
+  /* The canvas doesn't hold the last frame, so draw all of it */
+  bool stale_ = true;
+  SDL_Texture *canvas_ = nullptr;
+  /* One per command, in draw order */
+  std::vector<struct Mark> marks_;
+  /* This frame's and last frame's marks, by hash */
+  std::vector<struct Mark> sorted_;
+  std::vector<struct Mark> last_;
+  std::vector<SDL_Rect> dirty_;
+
+  /* false if there's no canvas to draw into, so the frame has to be drawn as usual */
+  bool DrawRetained() {
+    if (!canvas_ && sdl::TargetsSupported()) {
+      canvas_ = sdl::CreateTarget(sdl::kWindowX, sdl::kWindowY);
+      if (canvas_) SDL_SetTextureBlendMode(canvas_, SDL_BLENDMODE_NONE);
+      stale_ = true;
+    }
+    if (!canvas_) return false;
+    marks_.clear();
+    for (const Command &c : commands_)
+      marks_.push_back(Measure(c));
+    sorted_ = marks_;
+    std::sort(sorted_.begin(), sorted_.end(), Before);
+
+    const SDL_Rect window = { 0, 0, sdl::kWindowX, sdl::kWindowY };
+    dirty_.clear();
+    if (stale_ || sdl::window_exposed) {
+      dirty_.push_back(window);
+    } else {
+      size_t a = 0, b = 0;
+      while (a < last_.size() || b < sorted_.size()) {
+        if (b == sorted_.size() || (a < last_.size() && Before(last_[a], sorted_[b])))
+          Dirty(last_[a++].bounds);
+        else if (a == last_.size() || Before(sorted_[b], last_[a]))
+          Dirty(sorted_[b++].bounds);
+        else
+          ++a, ++b;
+      }
+    }
+    std::swap(last_, sorted_);
+    stale_ = false;
+    sdl::window_exposed = false;
+    /* What's on screen is still right */
+    if (dirty_.empty()) return true;
+
+    /* Past a point, one big rectangle costs less than walking the commands for each */
+    if (dirty_.size() > kMaxDirtyRects) {
+      for (size_t r = 1; r < dirty_.size(); ++r)
+        SDL_UnionRect(&dirty_[0], &dirty_[r], &dirty_[0]);
+      dirty_.resize(1);
+    }
+    sdl::StartCanvas(canvas_);
+    for (const SDL_Rect &rect : dirty_) {
+      SDL_Rect area;
+      if (!SDL_IntersectRect(&rect, &window, &area)) continue;
+      sdl::ClearArea(area);
+      Submit(&area);
+    }
+    sdl::ShowCanvas(canvas_);
+    return true;
+  }
+  /* Add a dirty rectangle, merging it with any it overlaps */
+  void Dirty(SDL_Rect rect) {
+    for (size_t r = 0; r < dirty_.size();) {
+      if (SDL_HasIntersection(&dirty_[r], &rect)) {
+        SDL_UnionRect(&dirty_[r], &rect, &rect);
+        dirty_[r] = dirty_.back();
+        dirty_.pop_back();
+        r = 0;
+      } else {
+        ++r;
+      }
+    }
+    dirty_.push_back(rect);
+  }
+  static bool Before(const struct Mark &l, const struct Mark &r) {
+    if (l.hash != r.hash) return l.hash < r.hash;
+    const SDL_Rect &a = l.bounds, &b = r.bounds;
+    if (a.x != b.x) return a.x < b.x;
+    if (a.y != b.y) return a.y < b.y;
+    if (a.w != b.w) return a.w < b.w;
+    return a.h < b.h;
+  }
+  static uint64_t Mix(uint64_t hash, uint64_t v) {
+    return hash ^ (v + 0x9e3779b97f4a7c15 + (hash << 6) + (hash >> 2));
+  }
+  static uint64_t Mix(uint64_t hash, float f) {
+    uint32_t bits;
+    memcpy(&bits, &f, sizeof(bits));
+    return Mix(hash, (uint64_t)bits);
+  }
+  static uint64_t Mix(uint64_t hash, v2d v) {
+    return Mix(Mix(hash, v.x), v.y);
+  }
+  /* Window rectangle covering x0, y0 to x1, y1, pad pixels bigger all round */
+  static SDL_Rect Around(float x0, float y0, float x1, float y1, float pad) {
+    int left = std::floor(std::min(x0, x1) - pad);
+    int top = std::floor(std::min(y0, y1) - pad);
+    int right = std::ceil(std::max(x0, x1) + pad);
+    int bottom = std::ceil(std::max(y0, y1) + pad);
+    return { left, top, right - left, bottom - top };
+  }
+  /* What Submit would draw for c, in the same window coordinates */
+  struct Mark Measure(const Command &c) const {
+    uint64_t hash = Mix(Mix((uint64_t)c.kind, c.key), (uint64_t)c.blend);
+    if (c.kind == Command::kLine) {
+      const struct TransientLine &l = *(const struct TransientLine *)c.item;
+      v2d from = ToScreen(l.pos), vec = l.vec * camera_.zoom;
+      hash = Mix(Mix(Mix(hash, from), vec), (uint64_t)l.nub);
+      /* The nub's far tip is kNibLength along each of two axes */
+      const float kRoot2 = 1.41421356;
+      float pad = l.nub ? sdl::kNibLength * kRoot2 + 1 : 1;
+      return { hash, Around(from.x, from.y, from.x + vec.x, from.y + vec.y, pad) };
+    }
+    if (c.kind == Command::kRect || c.kind == Command::kSprite) {
+      const struct Attributes &attr = *(const struct Attributes *)c.item;
+      v2d centre = ToScreen(attr.obj->pos);
+      float reach;
+      hash = Mix(Mix(hash, centre), camera_.zoom);
+      if (c.kind == Command::kRect) {
+        const float kRoot2 = 1.41421356;
+        hash = Mix(Mix(hash, attr.size), attr.point_at);
+        reach = attr.size / 2 * kRoot2 * camera_.zoom;
+      } else {
+        const struct Sprite &s = attr.sprite;
+        hash = Mix(Mix(Mix(Mix(hash, s.off), s.w), s.h), s.theta);
+        hash = Mix(Mix(hash, (uint64_t)s.texture.src.x), (uint64_t)s.texture.src.y);
+        reach = std::hypot(s.w, s.h) / 2 * camera_.zoom;
+      }
+      return { hash, Around(centre.x, centre.y, centre.x, centre.y, reach + 1) };
+    }
+    const struct TransientText &t = *(const struct TransientText *)c.item;
+    hash = Mix(Mix(hash, t.pos), (uint64_t)(uintptr_t)t.fontp);
+    hash = Mix(hash, (uint64_t)std::hash<std::string_view>{}(std::string_view(t.text, t.length)));
+    return { hash, Around(t.pos.x, t.pos.y, t.pos.x + t.dim.x, t.pos.y + t.dim.y, 1) };
+  }
+
+  /* The whole string as one run of quads at pos, straight from the glyph table */
+  void BatchText(const struct TransientText &t, v2d pos, SDL_Color color) {
+    const struct Font &f = *t.fontp;
+    batch_.vertices.reserve(batch_.vertices.size() + t.length * 4);
+    batch_.indices.reserve(batch_.indices.size() + t.length * 6);
+    float x0 = pos.x, y0 = pos.y, y1 = pos.y + f.h;
+    for (size_t c = 0; c < t.length; ++c, x0 += f.w) {
+      const struct Glyph &g = f.glyphs[(unsigned char)t.text[c]];
+      if (!g.defined) continue;
+      float x1 = x0 + f.w;
+      batch_.Quad(
+        { { x0, y0 }, { x1, y0 }, { x1, y1 }, { x0, y1 } },
+        { g.uv0, { g.uv1.x, g.uv0.y }, g.uv1, { g.uv0.x, g.uv1.y } },
+        color
+      );
+    }
+  }
+  static SDL_Color Color(const struct Attributes &attr) {
+    return { attr.r, attr.g, attr.b, 255 };
+  }
+  static constexpr SDL_Color kWhite = { 255, 255, 255, 255 };
+
+  /*
+   * Strings drawn before, already rendered into textures of their own,
+   * keyed by a hash of font, colour and string. Past kTextCacheBytes
+   * of texture the least recently drawn ones are thrown out.
+   */
+  static const size_t kTextCacheBytes = 4 << 20;
+  struct CachedText {
+    /* What was rendered, to tell hash collisions apart */
+    const struct Font *font;
+    uint32_t colour;
+    std::string text;
+    struct Texture texture;
+    size_t bytes;
+    /* Value of draws_ when it was last drawn */
+    uint64_t drawn;
+    std::list<size_t>::iterator lru;
+  };
+  std::unordered_map<size_t, struct CachedText> text_cache_;
+  /* Keys of text_cache_, most recently drawn first */
+  std::list<size_t> lru_;
+  size_t cached_bytes_ = 0;
+  uint64_t draws_ = 0;
+  unsigned next_texture_id_ = 1;
+
+  /*
+   * The cached texture for a piece of text, rendering it first if it
+   * isn't cached yet. nullptr if render targets aren't available, in
+   * which case the text is drawn glyph by glyph.
+   */
+  const struct Texture *CacheText(const struct TransientText &t) {
+    if (t.dim.x <= 0 || t.dim.y <= 0 || !sdl::TargetsSupported()) return nullptr;
+    uint32_t colour = t.color.r << 16 | t.color.g << 8 | t.color.b;
+    std::string_view text(t.text, t.length);
+    size_t hash = std::hash<std::string_view>{}(text);
+    hash ^= std::hash<const void *>{}(t.fontp) + 0x9e3779b9 + (hash << 6) + (hash >> 2);
+    hash ^= colour + 0x9e3779b9 + (hash << 6) + (hash >> 2);
+    auto it = text_cache_.find(hash);
+    if (it != text_cache_.end()) {
+      struct CachedText &c = it->second;
+      if (c.font == t.fontp && c.colour == colour && c.text == text) {
+        c.drawn = draws_;
+        lru_.splice(lru_.begin(), lru_, c.lru);
+        return &c.texture;
+      }
+      /* A different string with the same hash; make way for this one */
+      if (c.drawn == draws_) return nullptr;
+      Evict(it);
+    }
+    struct Texture texture;
+    texture.w = t.dim.x;
+    texture.h = t.dim.y;
+    texture.ptr = sdl::CreateTarget(texture.w, texture.h);
+    if (!texture.ptr) return nullptr;
+    texture.id = next_texture_id_++;
+    /* Glyphs are copied as they are, tinted, onto a clear background */
+    batch_.Clear();
+    batch_.texture = t.fontp->texture.ptr;
+    batch_.blend = SDL_BLENDMODE_NONE;
+    BatchText(t, { 0, 0 }, t.color);
+    sdl::DrawBatchInto(texture.ptr, batch_);
+    SDL_SetTextureBlendMode(texture.ptr, SDL_BLENDMODE_BLEND);
+    size_t bytes = (size_t)texture.w * texture.h * 4;
+    lru_.push_front(hash);
+    text_cache_[hash] = { t.fontp, colour, std::string(text), texture, bytes, draws_, lru_.begin() };
+    cached_bytes_ += bytes;
+    /* Anything drawn this frame stays until the frame is over */
+    while (cached_bytes_ > kTextCacheBytes) {
+      auto last = text_cache_.find(lru_.back());
+      if (last->second.drawn == draws_) break;
+      Evict(last);
+    }
+    return &text_cache_[hash].texture;
+  }
+  void Evict(std::unordered_map<size_t, struct CachedText>::iterator it) {
+    SDL_DestroyTexture(it->second.texture.ptr);
+    cached_bytes_ -= it->second.bytes;
+    lru_.erase(it->second.lru);
+    text_cache_.erase(it);
+  }
 }; // class Drawer
 
 #endif
\ No newline at end of file
@@ -1,73 +1,863 @@
 #ifndef OVERLAP_H
 #define OVERLAP_H
 
+#include <algorithm>
+#include <chrono>
+#include <cmath>
 #include <list>
+#include <memory>
+#include <ostream>
 #include <vector>
-#include <unordered_map>
 
 #include "object.h"
+#include "simd.h"
+#include "workers.h"
 #include "vector.h"
 
+/*
+ * Slab test: the earliest t in [0, 1] at which from + d * t is inside
+ * the box, grown by pad on every side. Starting inside gives t = 0.
+ */
+bool SegmentEntersRect(v2d from, v2d d, struct rect r, float pad, float &t) {
+  float lo[2] = { r.x - pad, r.y - pad };
+  float hi[2] = { r.x + r.w + pad, r.y + r.h + pad };
+  float p[2] = { from.x, from.y };
+  float v[2] = { d.x, d.y };
+  float t0 = 0, t1 = 1;
+  for (int i = 0; i < 2; ++i) {
+    if (v[i] == 0) {
+      if (p[i] < lo[i] || p[i] > hi[i]) return false;
+      continue;
+    }
+    float a = (lo[i] - p[i]) / v[i];
+    float b = (hi[i] - p[i]) / v[i];
+    if (a > b) std::swap(a, b);
+    t0 = std::max(t0, a);
+    t1 = std::min(t1, b);
+    if (t0 > t1) return false;
+  }
+  t = t0;
+  return true;
+}
+
+struct QuadItem {
+  size_t key;
+  struct rect bounds;
+};
+
 /* 
  * Reduce the number of collider-collider checks we need
  * to do by recursively partitioning space into fourths.
  */
-// template <typename CONTAINER>
-// class Quadtree {
-//  public:
-//   Quadtree(unsigned level, struct rect bounds) {
-//     bounds_ = bounds;
-//     level_ = level;
-//   }
-
-//   ~Quadtree() {
-//     Clear();
-//   }
+template <typename CONTAINER>
+class Quadtree {
+ public:
+  Quadtree(unsigned level, struct rect bounds) {
+    bounds_ = bounds;
+    level_ = level;
+  }
+
+  ~Quadtree() {
+    Clear();
+  }
   
-//   void Clear() {
-//     objs_.clear();
-//     /* Recursively clear child nodes */
-//     for (Quadtree<CONTAINER> &node : nodes_)
-//       node.Clear();
-//   }
+  void Clear() {
+    objs_.clear();
+    /* Recursively clear child nodes */
+    for (Quadtree<CONTAINER> &node : nodes_)
+      node.Clear();
+    nodes_.clear();
+    count_ = 0;
+  }
+
+  void Split() {
+    float hw = bounds_.w / 2;
+    float hh = bounds_.h / 2;
+    float x = bounds_.x;
+    float y = bounds_.y;
+    /* Reserve up front so the children never move once created */
+    nodes_.reserve(4);
+    nodes_.emplace_back(level_ + 1, rect{ x + hw, y, hw, hh });
+    nodes_.emplace_back(level_ + 1, rect{ x, y, hw, hh });
+    nodes_.emplace_back(level_ + 1, rect{ x, y + hh, hw, hh });
+    nodes_.emplace_back(level_ + 1, rect{ x + hw, y + hh, hw, hh });
+    /* Push down everything that fits entirely inside one child */
+    for (size_t i = 0; i < objs_.size();) {
+      int idx = GetIndex(objs_[i].bounds);
+      if (idx == -1) {
+        ++i;
+        continue;
+      }
+      nodes_[idx].Insert(objs_[i].key, objs_[i].bounds);
+      objs_[i] = objs_.back();
+      objs_.pop_back();
+    }
+  }
+
+  void Insert(size_t key, struct rect bounds) {
+    ++count_;
+    if (!nodes_.empty()) {
+      int idx = GetIndex(bounds);
+      if (idx != -1)
+        return nodes_[idx].Insert(key, bounds);
+    }
+    objs_.push_back({ key, bounds });
+    if (nodes_.empty() && objs_.size() > kMaxObjects_ && level_ < kMaxLevels_)
+      Split();
+  }
+
+  /* Remove the object that was inserted with these bounds */
+  bool Remove(size_t key, struct rect bounds) {
+    int idx = nodes_.empty() ? -1 : GetIndex(bounds);
+    bool found = idx == -1 ? Erase(key) : nodes_[idx].Remove(key, bounds);
+    if (found) {
+      --count_;
+      Collapse();
+    }
+    return found;
+  }
+
+  /*
+   * Incremental reinsertion: if the object's home node is still the
+   * right place for it, only its bounds get updated. Otherwise it is
+   * pulled out and put back in from the top of the tree.
+   */
+  void Move(size_t key, struct rect old, struct rect now) {
+    if (Relocate(key, old, now, true) == kMissing)
+      Insert(key, now);
+  }
+
+  /*
+   * Walk the nodes a segment (grown by pad) passes through, nearest
+   * first, calling visit(key) on objects it might hit. visit lowers
+   * best when it finds a hit, and anything entered after best is
+   * skipped. Returns how many nodes it went through.
+   */
+  template <typename F>
+  size_t Trace(v2d from, v2d d, float pad, float &best, F &&visit) {
+    float t;
+    for (const QuadItem &o : objs_)
+      if (SegmentEntersRect(from, d, o.bounds, pad, t) && t <= best)
+        visit(o.key);
+    size_t visited = 1;
+    if (nodes_.empty()) return visited;
+    float enter[4];
+    int order[4], n = 0;
+    for (int i = 0; i < 4; ++i) {
+      if (!SegmentEntersRect(from, d, nodes_[i].bounds_, pad, enter[i])) continue;
+      /* Insertion sort the children by entry time */
+      int j = n++;
+      for (; j > 0 && enter[order[j - 1]] > enter[i]; --j)
+        order[j] = order[j - 1];
+      order[j] = i;
+    }
+    for (int k = 0; k < n; ++k) {
+      if (enter[order[k]] > best) break;
+      visited += nodes_[order[k]].Trace(from, d, pad, best, visit);
+    }
+    return visited;
+  }
+
+  /*
+   * Call visit(key) for every object whose bounds overlap the query.
+   * Returns how many nodes it looked in.
+   */
+  template <typename F>
+  size_t Retrieve(struct rect query, F &&visit) {
+    for (const QuadItem &o : objs_)
+      if (Overlaps(o.bounds, query))
+        visit(o.key);
+    size_t visited = 1;
+    for (Quadtree<CONTAINER> &node : nodes_)
+      if (Overlaps(node.bounds_, query))
+        visited += node.Retrieve(query, visit);
+    return visited;
+  }
+ private:
+  /*
+   * Get the index, from 0-3, of the subtree that this query fits in.
+   * If the query fits in multiple subnodes, return -1 to mean "parent"
+   */
+  int GetIndex(rect query) {
+    int idx = -1;
+    float mx = bounds_.x + bounds_.w / 2;
+    float my = bounds_.y + bounds_.h / 2;
+    bool top = query.y >= bounds_.y && query.y + query.h < my;
+    bool bottom = query.y >= my && query.y + query.h <= bounds_.y + bounds_.h;
+    bool left = query.x >= bounds_.x && query.x + query.w < mx;
+    bool right = query.x >= mx && query.x + query.w <= bounds_.x + bounds_.w;
+    if (top && right) idx = 0;
+    if (top && left) idx = 1;
+    if (bottom && left) idx = 2;
+    if (bottom && right) idx = 3;
+    return idx;
+  }
+
+  static bool Overlaps(const struct rect &a, const struct rect &b) {
+    return a.x <= b.x + b.w && a.x + a.w >= b.x &&
+           a.y <= b.y + b.h && a.y + a.h >= b.y;
+  }
+
+  bool Erase(size_t key) {
+    for (size_t i = 0; i < objs_.size(); ++i) {
+      if (objs_[i].key != key) continue;
+      objs_[i] = objs_.back();
+      objs_.pop_back();
+      return true;
+    }
+    return false;
+  }
+
+  enum Moved {
+    kMissing,
+    kStayed,
+    kLeft
+  };
+  /*
+   * kLeft means the object had to leave this subtree entirely.
+   * fits says whether the ancestors would still send now down to us.
+   */
+  Moved Relocate(size_t key, struct rect old, struct rect now, bool fits) {
+    int idx = nodes_.empty() ? -1 : GetIndex(old);
+    if (idx != -1) {
+      Moved m = nodes_[idx].Relocate(key, old, now, fits && GetIndex(now) == idx);
+      if (m != kLeft) return m;
+      /* The child lost the object; take it back if it fits here */
+      --count_;
+      if (fits) {
+        Insert(key, now);
+        return kStayed;
+      }
+      Collapse();
+      return kLeft;
+    }
+    for (QuadItem &o : objs_) {
+      if (o.key != key) continue;
+      if (fits && (nodes_.empty() || GetIndex(now) == -1)) {
+        o.bounds = now;
+        return kStayed;
+      }
+      Erase(key);
+      --count_;
+      if (fits) {
+        Insert(key, now);
+        return kStayed;
+      }
+      Collapse();
+      return kLeft;
+    }
+    return kMissing;
+  }
+
+  /* Fold the children back in once the subtree has thinned out */
+  void Collapse() {
+    if (nodes_.empty() || count_ > kMaxObjects_ / 2) return;
+    for (Quadtree<CONTAINER> &node : nodes_)
+      node.Gather(objs_);
+    nodes_.clear();
+  }
+  void Gather(CONTAINER &out) {
+    out.insert(out.end(), objs_.begin(), objs_.end());
+    for (Quadtree<CONTAINER> &node : nodes_)
+      node.Gather(out);
+  }
+
+  static const unsigned kMaxObjects_ = 16;
+  static const unsigned kMaxLevels_ = 4;
+
+  struct rect bounds_;
+
+  unsigned level_;
+  /* Number of objects in this node and all of its children */
+  unsigned count_ = 0;
+  std::vector<Quadtree<CONTAINER>> nodes_;
+
+  CONTAINER objs_;
+}; // class Quadtree
+
+/*
+ * Uniform grid broadphase. Space is cut into square cells of
+ * kCellSize, and every cell hashes into one of kBuckets buckets.
+ * A collider is listed in every cell its bounds touch, so a query
+ * only has to look at the handful of cells around it.
+ */
+class SpatialHash {
+ public:
+  static constexpr float kCellSize = 32.0;
+
+  /* Keys are small dense ids, so placement is tracked in a flat array */
+  void Insert(size_t key, struct rect bounds) {
+    Cells c = ToCells(bounds);
+    if (key >= placed_.size()) placed_.resize(key + 1, kNowhere);
+    placed_[key] = c;
+    Add(key, c);
+  }
+  void Remove(size_t key) {
+    if (!Placed(key)) return;
+    Sub(key, placed_[key]);
+    placed_[key] = kNowhere;
+  }
+  /* Only touches buckets if the collider crossed into a new cell */
+  void Move(size_t key, struct rect bounds) {
+    if (!Placed(key)) return Insert(key, bounds);
+    Cells &old = placed_[key];
+    Cells c = ToCells(bounds);
+    if (c.x0 == old.x0 && c.y0 == old.y0 && c.x1 == old.x1 && c.y1 == old.y1)
+      return;
+    Sub(key, old);
+    Add(key, c);
+    old = c;
+  }
+  /*
+   * Step through the cells a segment passes over in order (a DDA walk),
+   * calling visit(key) on colliders within pad of each one. visit lowers
+   * best when it finds a hit; a hit can only come from the cell the
+   * segment is in at that time, so the walk stops once it has left
+   * every cell up to best. Returns how many cells it looked in.
+   */
+  template <typename F>
+  size_t Trace(v2d from, v2d d, float pad, float &best, F &&visit) {
+    int cx = ToCell(from.x), cy = ToCell(from.y);
+    int step_x = d.x > 0 ? 1 : -1, step_y = d.y > 0 ? 1 : -1;
+    /* t at which the segment crosses the next cell boundary on each axis */
+    float next_x = d.x == 0 ? INFINITY :
+      ((cx + (step_x > 0)) * kCellSize - from.x) / d.x;
+    float next_y = d.y == 0 ? INFINITY :
+      ((cy + (step_y > 0)) * kCellSize - from.y) / d.y;
+    float delta_x = d.x == 0 ? INFINITY : kCellSize / std::abs(d.x);
+    float delta_y = d.y == 0 ? INFINITY : kCellSize / std::abs(d.y);
+    size_t visited = 0;
+    for (;;) {
+      struct rect cell = { cx * kCellSize, cy * kCellSize, kCellSize, kCellSize };
+      if (pad > 0) {
+        visited += Query({ cell.x - pad, cell.y - pad, cell.w + pad * 2, cell.h + pad * 2 }, visit);
+      } else {
+        for (const Entry &e : buckets_[Hash(cx, cy)])
+          if (e.cx == cx && e.cy == cy)
+            visit(e.key);
+        ++visited;
+      }
+      float leave = std::min(next_x, next_y);
+      if (leave >= best || leave >= 1) return visited;
+      if (next_x < next_y) {
+        cx += step_x;
+        next_x += delta_x;
+      } else {
+        cy += step_y;
+        next_y += delta_y;
+      }
+    }
+  }
+
+  /*
+   * Call visit(key) once for every collider sharing a cell with bounds.
+   * Returns how many cells it looked in.
+   */
+  template <typename F>
+  size_t Query(struct rect bounds, F &&visit) {
+    Cells q = ToCells(bounds);
+    for (int cy = q.y0; cy <= q.y1; ++cy)
+      for (int cx = q.x0; cx <= q.x1; ++cx)
+        for (const Entry &e : buckets_[Hash(cx, cy)]) {
+          /*
+           * Skip entries from other cells that hashed into this bucket,
+           * which may be other cells of the same collider
+           */
+          if (e.cx != cx || e.cy != cy)
+            continue;
+          /*
+           * A collider spanning several cells is only reported from
+           * the first cell it shares with the query
+           */
+          if (cx != std::max(e.c.x0, q.x0) || cy != std::max(e.c.y0, q.y0))
+            continue;
+          visit(e.key);
+        }
+    return (size_t)(q.x1 - q.x0 + 1) * (q.y1 - q.y0 + 1);
+  }
+
+ private:
+  static const unsigned kBuckets = 1024;
+
+  struct Cells {
+    int x0, y0, x1, y1;
+  };
+  struct Entry {
+    size_t key;
+    /* All the cells the collider covers, and the one this entry is for */
+    Cells c;
+    int cx, cy;
+  };
+  /* Empty cell range for keys that aren't in the grid */
+  static constexpr Cells kNowhere = { 1, 1, 0, 0 };
+
+  bool Placed(size_t key) {
+    return key < placed_.size() && placed_[key].x0 <= placed_[key].x1;
+  }
+
+  static int ToCell(float f) {
+    return (int)std::floor(f / kCellSize);
+  }
+  static Cells ToCells(struct rect r) {
+    return { ToCell(r.x), ToCell(r.y), ToCell(r.x + r.w), ToCell(r.y + r.h) };
+  }
+  static unsigned Hash(int cx, int cy) {
+    return ((unsigned)cx * 73856093u ^ (unsigned)cy * 19349663u) & (kBuckets - 1);
+  }
+  void Add(size_t key, Cells c) {
+    for (int cy = c.y0; cy <= c.y1; ++cy)
+      for (int cx = c.x0; cx <= c.x1; ++cx)
+        buckets_[Hash(cx, cy)].push_back({ key, c, cx, cy });
+  }
+  void Sub(size_t key, Cells c) {
+    for (int cy = c.y0; cy <= c.y1; ++cy)
+      for (int cx = c.x0; cx <= c.x1; ++cx) {
+        std::vector<Entry> &b = buckets_[Hash(cx, cy)];
+        for (size_t i = 0; i < b.size(); ++i) {
+          if (b[i].key != key || b[i].cx != cx || b[i].cy != cy) continue;
+          b[i] = b.back();
+          b.pop_back();
+          break;
+        }
+      }
+  }
+
+  std::vector<Entry> buckets_[kBuckets];
+  std::vector<Cells> placed_;
+}; // class SpatialHash
+
+/*
+ * Sweep and prune broadphase. The extents of every collider on each
+ * axis live in a sorted list that is kept between frames, so after a
+ * frame of motion an insertion sort only has to shuffle a few
+ * entries. A min swapping past a max means a pair started or stopped
+ * overlapping on that axis; checking the other axis there keeps a
+ * persistent set of pairs whose bounds overlap, at a cost that goes
+ * with how much things moved rather than how many there are.
+ */
+class SweepAndPrune {
+ public:
+  struct Pair {
+    size_t a;
+    size_t b;
+  };
+  /* One side of a pair, kept in both colliders' lists */
+  struct Partner {
+    size_t key;
+    /* Whether the shapes touched when last tested; only kept on the lower key's side */
+    bool touching;
+  };
 
-//   void Split() {
+  /* Without track_pairs it only answers queries, sorts x alone and has no pairs */
+  explicit SweepAndPrune(bool track_pairs = true) : track_pairs_(track_pairs) {}
 
-//   }
+  /* Keys are small dense ids, so boxes and pair lists are kept in flat arrays */
+  void Insert(size_t key, struct rect bounds) {
+    if (key >= boxes_.size()) {
+      boxes_.resize(key + 1);
+      partners_.resize(key + 1);
+      moved_.resize(key + 1, false);
+    }
+    boxes_[key] = bounds;
+    max_w_ = std::max(max_w_, bounds.w);
+    for (int axis = 0; axis < (track_pairs_ ? 2 : 1); ++axis) {
+      Place(axis, { Min(bounds, axis), key, true });
+      Place(axis, { Max(bounds, axis), key, false });
+    }
+    if (!track_pairs_) return;
+    /* Pick up everything the new collider overlaps */
+    Sweep(bounds, [&](size_t other) {
+      if (other != key) Link(key, other);
+    });
+    Moved(key);
+  }
+  /* Costs a pass over the endpoints and the collider's own pairs */
+  void Remove(size_t key) {
+    if (key >= boxes_.size()) return;
+    for (std::vector<Endpoint> &list : endpoints_)
+      list.erase(
+        std::remove_if(list.begin(), list.end(), [&](const Endpoint &e) { return e.key == key; }),
+        list.end()
+      );
+    if (!track_pairs_) return;
+    for (const Partner &p : partners_[key]) {
+      if (Touching(key, p.key)) lost_.push_back(Ordered(key, p.key));
+      Erase(partners_[p.key], key);
+    }
+    partners_[key].clear();
+  }
+  /* Record new bounds; the lists are only re-sorted by Sort() */
+  void Move(size_t key, struct rect bounds) {
+    boxes_[key] = bounds;
+    if (track_pairs_) Moved(key);
+  }
+  /*
+   * Insertion sort the endpoints, updating pairs as they swap. Returns
+   * how many endpoints it stepped over, each swap counting once more.
+   */
+  size_t Sort() {
+    size_t visited = 0;
+    max_w_ = 0;
+    for (int axis = 0; axis < (track_pairs_ ? 2 : 1); ++axis) {
+      std::vector<Endpoint> &list = endpoints_[axis];
+      for (Endpoint &e : list) {
+        struct rect &b = boxes_[e.key];
+        e.value = e.is_min ? Min(b, axis) : Max(b, axis);
+        if (axis == 0) max_w_ = std::max(max_w_, b.w);
+      }
+      visited += list.size();
+      for (size_t i = 1; i < list.size(); ++i) {
+        Endpoint e = list[i];
+        size_t j = i;
+        for (; j > 0 && Less(e, list[j - 1]); --j) {
+          Endpoint &o = list[j - 1];
+          if (track_pairs_ && o.key != e.key) {
+            /*
+             * A min moving left past a max starts an overlap on this
+             * axis, and the pair is in if the other axis agrees; a max
+             * moving left past a min ends one. Both look at where
+             * things are now, so the set comes out right whatever
+             * order the swaps happen in.
+             */
+            if (e.is_min && !o.is_min && Overlaps(boxes_[e.key], boxes_[o.key]))
+              Link(e.key, o.key);
+            if (!e.is_min && o.is_min)
+              Unlink(e.key, o.key);
+          }
+          list[j] = o;
+          ++visited;
+        }
+        list[j] = e;
+      }
+    }
+    return visited;
+  }
+  /*
+   * Call visit(key) for every collider whose bounds overlap the query.
+   * Returns how many endpoints it stepped over.
+   */
+  template <typename F>
+  size_t Query(struct rect q, F &&visit) {
+    return Sweep(q, visit);
+  }
 
-//   void Insert();
+  /* Every pair whose bounds overlap, as (a, b) with a < b, in that order */
+  template <typename F>
+  void ForPairs(F &&fn) {
+    for (size_t a = 0; a < partners_.size(); ++a)
+      for (const Partner &p : partners_[a])
+        if (p.key > a) fn(Pair{ a, p.key });
+  }
+  /* Colliders inserted or moved since ClearMoved(), and their pairs */
+  const std::vector<size_t> &MovedKeys() const { return moved_keys_; }
+  bool WasMoved(size_t key) const { return moved_[key]; }
+  const std::vector<Partner> &Partners(size_t key) const { return partners_[key]; }
+  void ClearMoved() {
+    for (size_t key : moved_keys_) moved_[key] = false;
+    moved_keys_.clear();
+  }
+  /* Whether a pair in the set touched when last tested */
+  bool &Touching(size_t a, size_t b) {
+    Pair p = Ordered(a, b);
+    return Find(partners_[p.a], p.b)->touching;
+  }
+  /* Touching pairs that fell out of the pair set since the last call */
+  std::vector<Pair> &Lost() { return lost_; }
 
-//   CONTAINER Retrieve();
-//  private:
-//   /*
-//    * Get the index, from 0-3, of the subtree that this query fits in.
-//    * If the query fits in multiple subnodes, return -1 to mean "parent"
-//    */
-//   int GetIndex(rect query) {
-//     int idx = -1;
-    
-//   }
+ private:
+  struct Endpoint {
+    float value;
+    size_t key;
+    bool is_min;
+  };
 
-//   static const unsigned kMaxObjects_ = 16;
-//   static const unsigned kMaxLevels_ = 4;
+  static float Min(const struct rect &b, int axis) { return axis ? b.y : b.x; }
+  static float Max(const struct rect &b, int axis) { return axis ? b.y + b.h : b.x + b.w; }
+  static bool Overlaps(const struct rect &a, const struct rect &b) {
+    return a.x <= b.x + b.w && b.x <= a.x + a.w && a.y <= b.y + b.h && b.y <= a.y + a.h;
+  }
+  /* At equal values mins sort first, so touching extents count as overlapping */
+  static bool Less(const Endpoint &l, const Endpoint &r) {
+    return l.value < r.value || (l.value == r.value && l.is_min && !r.is_min);
+  }
+  static Pair Ordered(size_t a, size_t b) {
+    return a < b ? Pair{ a, b } : Pair{ b, a };
+  }
+  template <typename F>
+  size_t Sweep(struct rect q, F &&visit) {
+    /* Anything overlapping the query has its min within max_w_ of it */
+    const std::vector<Endpoint> &list = endpoints_[0];
+    Endpoint lo = { q.x - max_w_, 0, true };
+    auto first = std::lower_bound(list.begin(), list.end(), lo, Less);
+    auto it = first;
+    for (; it != list.end() && it->value <= q.x + q.w; ++it) {
+      if (!it->is_min) continue;
+      struct rect &b = boxes_[it->key];
+      if (b.x + b.w < q.x) continue;
+      if (b.y > q.y + q.h || b.y + b.h < q.y) continue;
+      visit(it->key);
+    }
+    return it - first;
+  }
+  void Place(int axis, Endpoint e) {
+    std::vector<Endpoint> &list = endpoints_[axis];
+    list.insert(std::upper_bound(list.begin(), list.end(), e, Less), e);
+  }
+  void Moved(size_t key) {
+    if (moved_[key]) return;
+    moved_[key] = true;
+    moved_keys_.push_back(key);
+  }
 
-//   struct rect bounds_;
+  /* Partner lists are sorted by key, so a pair is a binary search away */
+  static std::vector<Partner>::iterator Find(std::vector<Partner> &list, size_t key) {
+    return std::lower_bound(list.begin(), list.end(), key, [](const Partner &p, size_t k) {
+      return p.key < k;
+    });
+  }
+  static bool Has(std::vector<Partner> &list, size_t key) {
+    auto it = Find(list, key);
+    return it != list.end() && it->key == key;
+  }
+  static void Erase(std::vector<Partner> &list, size_t key) {
+    auto it = Find(list, key);
+    if (it != list.end() && it->key == key) list.erase(it);
+  }
+  void Link(size_t a, size_t b) {
+    if (Has(partners_[a], b)) return;
+    partners_[a].insert(Find(partners_[a], b), { b, false });
+    partners_[b].insert(Find(partners_[b], a), { a, false });
+  }
+  void Unlink(size_t a, size_t b) {
+    if (!Has(partners_[a], b)) return;
+    if (Touching(a, b)) lost_.push_back(Ordered(a, b));
+    Erase(partners_[a], b);
+    Erase(partners_[b], a);
+  }
 
-//   unsigned level_;
-//   std::vector<Quadtree<CONTAINER>> nodes_;
+  /* x endpoints, then y; y is only kept when tracking pairs */
+  std::vector<Endpoint> endpoints_[2];
+  std::vector<struct rect> boxes_;
+  std::vector<std::vector<Partner>> partners_;
+  std::vector<Pair> lost_;
+  std::vector<bool> moved_;
+  std::vector<size_t> moved_keys_;
+  /* Widest collider, bounds how far left of a query we have to look */
+  float max_w_ = 0;
+  bool track_pairs_;
+}; // class SweepAndPrune
 
-//   CONTAINER objs_;
-// }; // class Quadtree
+/*
+ * Bounding volume hierarchy over colliders that never move. It is
+ * built in one go, splitting at the median on the longer axis, and
+ * never updated after that. Each node keeps the union of its
+ * colliders' layer masks, so queries skip subtrees with nothing in
+ * the layers they want.
+ */
+class StaticTree {
+ public:
+  struct Item {
+    size_t key;
+    struct rect bounds;
+    unsigned mask;
+  };
+
+  void Build(std::vector<Item> items) {
+    items_ = std::move(items);
+    nodes_.clear();
+    if (items_.empty()) return;
+    nodes_.push_back({});
+    Build(0, 0, items_.size());
+  }
+  bool Empty() const { return nodes_.empty(); }
+
+  /*
+   * Call visit(key) for every item in mask whose bounds overlap the
+   * query. Returns how many nodes it looked at.
+   */
+  template <typename F>
+  size_t Query(struct rect q, unsigned mask, F &&visit) {
+    if (nodes_.empty()) return 0;
+    unsigned stack[64];
+    int top = 0;
+    stack[top++] = 0;
+    size_t visited = 0;
+    while (top > 0) {
+      const Node &n = nodes_[stack[--top]];
+      ++visited;
+      if ((n.mask & mask) == 0 || !Overlaps(n.bounds, q)) continue;
+      if (n.count == 0) {
+        stack[top++] = n.first;
+        stack[top++] = n.first + 1;
+        continue;
+      }
+      for (unsigned i = n.first; i < n.first + n.count; ++i)
+        if ((items_[i].mask & mask) && Overlaps(items_[i].bounds, q))
+          visit(items_[i].key);
+    }
+    return visited;
+  }
+
+  /* Same contract as Quadtree::Trace, restricted to items in mask */
+  template <typename F>
+  size_t Trace(v2d from, v2d d, float pad, unsigned mask, float &best, F &&visit) {
+    float t;
+    if (nodes_.empty() || !SegmentEntersRect(from, d, nodes_[0].bounds, pad, t))
+      return 0;
+    return Trace(0, t, from, d, pad, mask, best, visit);
+  }
+
+ private:
+  /* Interior nodes have count 0 and their children at first, first + 1 */
+  struct Node {
+    struct rect bounds;
+    unsigned mask;
+    unsigned first;
+    unsigned count;
+  };
+
+  static const unsigned kLeafSize = 4;
+
+  static bool Overlaps(const struct rect &a, const struct rect &b) {
+    return a.x <= b.x + b.w && a.x + a.w >= b.x &&
+           a.y <= b.y + b.h && a.y + a.h >= b.y;
+  }
+
+  void Build(unsigned at, size_t begin, size_t end) {
+    struct rect box = items_[begin].bounds;
+    unsigned mask = 0;
+    for (size_t i = begin; i < end; ++i) {
+      const struct rect &b = items_[i].bounds;
+      float x1 = std::max(box.x + box.w, b.x + b.w);
+      float y1 = std::max(box.y + box.h, b.y + b.h);
+      box.x = std::min(box.x, b.x);
+      box.y = std::min(box.y, b.y);
+      box.w = x1 - box.x;
+      box.h = y1 - box.y;
+      mask |= items_[i].mask;
+    }
+    nodes_[at].bounds = box;
+    nodes_[at].mask = mask;
+    if (end - begin <= kLeafSize) {
+      nodes_[at].first = begin;
+      nodes_[at].count = end - begin;
+      return;
+    }
+    /* Median split on centers along the longer side */
+    size_t mid = begin + (end - begin) / 2;
+    bool on_x = box.w >= box.h;
+    std::nth_element(
+      items_.begin() + begin, items_.begin() + mid, items_.begin() + end,
+      [on_x](const Item &l, const Item &r) {
+        return on_x ? l.bounds.x * 2 + l.bounds.w < r.bounds.x * 2 + r.bounds.w
+                    : l.bounds.y * 2 + l.bounds.h < r.bounds.y * 2 + r.bounds.h;
+      }
+    );
+    unsigned left = nodes_.size();
+    nodes_[at].first = left;
+    nodes_[at].count = 0;
+    nodes_.push_back({});
+    nodes_.push_back({});
+    Build(left, begin, mid);
+    Build(left + 1, mid, end);
+  }
+
+  template <typename F>
+  size_t Trace(
+    unsigned at, float enter, v2d from, v2d d, float pad, unsigned mask,
+    float &best, F &&visit
+  ) {
+    const Node &n = nodes_[at];
+    if ((n.mask & mask) == 0 || enter > best) return 1;
+    float t;
+    if (n.count > 0) {
+      for (unsigned i = n.first; i < n.first + n.count; ++i)
+        if ((items_[i].mask & mask) &&
+            SegmentEntersRect(from, d, items_[i].bounds, pad, t) && t <= best)
+          visit(items_[i].key);
+      return 1;
+    }
+    /* Nearer child first so its hits can cut the other one short */
+    float ta, tb;
+    bool a = SegmentEntersRect(from, d, nodes_[n.first].bounds, pad, ta);
+    bool b = SegmentEntersRect(from, d, nodes_[n.first + 1].bounds, pad, tb);
+    unsigned near = n.first, far = n.first + 1;
+    if (a && b && tb < ta) {
+      std::swap(near, far);
+      std::swap(ta, tb);
+    } else if (!a) {
+      std::swap(near, far);
+      ta = tb;
+      a = b;
+      b = false;
+    }
+    size_t visited = 1;
+    if (a) visited += Trace(near, ta, from, d, pad, mask, best, visit);
+    if (b) visited += Trace(far, tb, from, d, pad, mask, best, visit);
+    return visited;
+  }
+
+  std::vector<Node> nodes_;
+  std::vector<Item> items_;
+}; // class StaticTree
+
+/*
+ * Collider shapes stored column-wise, which is the layout the
+ * simd:: kernels want. Each shape is a center plus half extents;
+ * circles keep their radius in ex.
+ */
+struct Columns {
+  std::vector<float> x;
+  std::vector<float> y;
+  std::vector<float> ex;
+  std::vector<float> ey;
+
+  size_t size() const { return x.size(); }
+  void clear() {
+    x.clear();
+    y.clear();
+    ex.clear();
+    ey.clear();
+  }
+  void push_back(struct rect r) {
+    x.push_back(r.x + r.w / 2);
+    y.push_back(r.y + r.h / 2);
+    ex.push_back(r.w / 2);
+    ey.push_back(r.h / 2);
+  }
+  void Set(size_t i, struct rect r) {
+    x[i] = r.x + r.w / 2;
+    y[i] = r.y + r.h / 2;
+    ex[i] = r.w / 2;
+    ey[i] = r.h / 2;
+  }
+  struct rect Rect(size_t i) const {
+    return { x[i] - ex[i], y[i] - ey[i], ex[i] * 2, ey[i] * 2 };
+  }
+  void Swap(size_t i, size_t j) {
+    std::swap(x[i], x[j]);
+    std::swap(y[i], y[j]);
+    std::swap(ex[i], ex[j]);
+    std::swap(ey[i], ey[j]);
+  }
+  void pop_back() {
+    x.pop_back();
+    y.pop_back();
+    ex.pop_back();
+    ey.pop_back();
+  }
+};
 
 class Collision {
  public:
   struct Attributes {
     enum Type {
       AABB,
-      Circle
+      Circle,
+      OBB
     };
     Type type = Circle;
-    /* type-specific traits; width and height for aabb, radius for circle */
+    /* type-specific traits; width and height for aabb/obb, radius for circle */
     union {
       struct {
         float w;
@@ -77,55 +867,411 @@ class Collision {
         float r;
       };
     } traits;
-    /* collision layer mask a la unity */
-    unsigned mask;
+    /*
+     * collision layer mask a la unity. The collider is filed under each
+     * of its bits when registered, so don't change it afterwards.
+     */
+    unsigned mask = 1;
     /* Data to be returned when someone overlaps with this object */
-    void *data;
+    void *data = nullptr;
     /* Pointer back to the object */
-    Object *obj;
+    Object *obj = nullptr;
+    /*
+     * Never moves. Static colliders go into a tree that is built once
+     * rather than updated every frame, and are never paired with each
+     * other. Set before Register.
+     */
+    bool is_static = false;
+    /*
+     * OBB only: the direction its (w, h) corner points in, same as
+     * Drawer::PointAt, so a square matches what the Drawer draws
+     */
+    v2d point_at = { 1.0, 0.0 };
+  };
+
+  /*
+   * Returned by Register and used to refer to a collider afterwards.
+   * The generation goes stale once the collider is unregistered, so a
+   * leftover handle never aliases whoever reuses the slot.
+   */
+  struct Handle {
+    unsigned slot = 0;
+    unsigned generation = 0;
   };
 
-  void Register(Object &object) {
-    map_[object.key] = Attributes();
-    map_[object.key].obj = &object;
+  /* Which structure narrows down the colliders a query has to test */
+  enum Broadphase {
+    kGrid,
+    kQuadtree,
+    kSweepAndPrune
+  };
+
+  /*
+   * Two overlapping colliders; a matched the first mask, b the second.
+   * Only valid until the next Register or Unregister.
+   */
+  struct Pair {
+    struct Attributes *a;
+    struct Attributes *b;
+  };
+
+  /* A pair of colliders that started or stopped overlapping */
+  struct Event {
+    struct Attributes a;
+    struct Attributes b;
+  };
+
+  /* world is the area the quadtree subdivides; colliders outside it still work */
+  Collision(Broadphase mode = kGrid, struct rect world = { 0, 0, 1024, 1024 })
+    : mode_(mode), world_(world) {}
+
+  Handle Register(Object &object) {
+    return Register(object, Attributes());
   }
-  void Register(Object &object, struct Attributes attr) {
-    map_[object.key] = attr;
-    map_[object.key].obj = &object;
+  Handle Register(Object &object, struct Attributes attr) {
+    struct Meter meter(*this);
+    unsigned slot;
+    if (free_.empty()) {
+      slot = slots_.size();
+      slots_.push_back({ 0, 1 });
+    } else {
+      slot = free_.back();
+      free_.pop_back();
+    }
+    slots_[slot].dense = attrs_.size();
+    if (coherence_.size() < slots_.size()) coherence_.resize(slots_.size());
+    coherence_[slot] = Coherence();
+    /* Anyone's cached clearance on these layers may no longer hold */
+    for (unsigned bits = attr.mask; bits; bits &= bits - 1)
+      ++epoch_[__builtin_ctz(bits)];
+    attr.obj = &object;
+    attrs_.push_back(attr);
+    owner_.push_back(slot);
+    shape_.push_back(Bounds(attr));
+    /* Statics are kept at the front of the dense arrays */
+    if (attr.is_static) Swap(slots_[slot].dense, statics_++);
+    Index(slot, shape_.Rect(slots_[slot].dense));
+    return { slot, slots_[slot].generation };
   }
-  void Unregister(Object &object) {
-    if (map_.find(object.key) == map_.end()) return;
-    map_.erase(object.key);
+  void Unregister(Handle h) {
+    if (!Valid(h)) return;
+    struct Meter meter(*this);
+    Deindex(h.slot);
+    /* Swap-remove from the dense arrays, keeping the statics up front */
+    unsigned d = slots_[h.slot].dense;
+    if (d < statics_) {
+      Swap(d, --statics_);
+      d = statics_;
+    }
+    Swap(d, attrs_.size() - 1);
+    shape_.pop_back();
+    attrs_.pop_back();
+    owner_.pop_back();
+    ++slots_[h.slot].generation;
+    free_.push_back(h.slot);
   }
-  bool Check(const Object &a, const Object &b) {
+  /* Turn an OBB; it gets re-binned on the next Update() */
+  void PointAt(Handle h, v2d dir) {
+    if (Valid(h)) attrs_[slots_[h.slot].dense].point_at = dir;
+  }
+  /* Attributes of a live collider, or nullptr if the handle is stale */
+  Attributes *Get(Handle h) {
+    return Valid(h) ? &attrs_[slots_[h.slot].dense] : nullptr;
+  }
+  /*
+   * Re-bin colliders that moved; call once per frame after moving
+   * things. Also where one frame's Stats end and the next one's begin.
+   */
+  void Update() {
+    if (!history_.empty()) history_[recorded_++ % history_.size()] = frame_;
+    frame_ = Stats();
+    struct Meter meter(*this);
+    for (size_t d = statics_; d < attrs_.size(); ++d)
+      Reindex(owner_[d], d, Bounds(attrs_[d]));
+    for (unsigned bit = 0; bit < 32; ++bit) {
+      drift_[bit] += moved_[bit];
+      moved_[bit] = 0;
+    }
+    if (mode_ == kSweepAndPrune) {
+      for (auto &layer : layers_)
+        if (layer) scratch_[0].tally.visited += layer->Sort();
+      Track();
+    }
+  }
+  /*
+   * Pairs that began or ended overlapping during the last Update().
+   * Only tracked in kSweepAndPrune mode. Pairs are reported whatever
+   * their masks are, so filter on a.mask / b.mask.
+   */
+  const std::vector<struct Event> &Began() { return began_; }
+  const std::vector<struct Event> &Ended() { return ended_; }
+  bool Check(Handle a, Handle b) {
     /* Check both objects are registered in the subsystem */
-    if (map_.find(a.key) == map_.end()) return false;
-    if (map_.find(b.key) == map_.end()) return false;
-    /* Get their attributes */
-    struct Attributes *at = &map_[a.key];
-    struct Attributes *bt = &map_[b.key];
-    /* Call appropriate overlap function */
-    if (at->type == Attributes::AABB && bt->type == Attributes::AABB)
-      return AabbAabb(
-        at->traits.w, at->traits.h, at->obj->pos,
-        bt->traits.w, bt->traits.h, bt->obj->pos
-      );
-    if (at->type == Attributes::Circle && bt->type == Attributes::Circle)
-      return CircleCircle(
-        at->traits.r, at->obj->pos,
-        bt->traits.r, bt->obj->pos
-      );
-    return false;
+    if (!Valid(a) || !Valid(b)) return false;
+    struct Meter meter(*this);
+    return Tested(scratch_[0], Overlap(attrs_[slots_[a.slot].dense], attrs_[slots_[b.slot].dense]));
   }
-  Attributes *CheckAgainst(const Object &query, unsigned mask) {
-    for (auto &[_, attr] : map_) {
-      /* Skip objects whose layermask doesn't match the query */
-      if ((attr.mask & mask) == 0)
-        continue;
-      if (Check(query, *attr.obj))
-        return &attr;
+  /*
+   * A collider in mask that the query overlaps, or nullptr. Asking
+   * again for the same query and mask is often answered from what the
+   * last call found: the collider it returned, while they still
+   * overlap, or that everything was far enough away that nothing can
+   * have reached it since.
+   */
+  Attributes *CheckAgainst(Handle query, unsigned mask) {
+    if (!Valid(query)) return nullptr;
+    struct Meter meter(*this);
+    unsigned qd = slots_[query.slot].dense;
+    struct rect q = Bounds(attrs_[qd]);
+    struct Scratch &sc = scratch_[0];
+    struct Coherence &last = coherence_[query.slot];
+    if (last.mask == mask) {
+      /* Test the last hit on its own, the same way the search would */
+      const Handle &w = last.witness;
+      if (Valid(w) && (At(w.slot).mask & mask)) {
+        sc.Clear();
+        Gather(sc, slots_[w.slot].dense);
+        bool still = false;
+        Narrow(sc, attrs_[qd], q, [&](unsigned) { still = true; });
+        if (still) return &At(w.slot);
+      }
+      /* Both sides can only have closed the gap by as much as they moved */
+      float moved = Shift(last.q, q) + (Drift(mask) - last.drift);
+      if (last.clearance > moved && last.epoch == Epoch(mask))
+        return nullptr;
+    }
+    Bake();
+    sc.Clear();
+    /* Look a little further out to measure the clearance on a miss */
+    float clearance = kClearance;
+    struct rect around = {
+      q.x - kClearance, q.y - kClearance, q.w + kClearance * 2, q.h + kClearance * 2
+    };
+    Candidates(sc, around, mask, [&](size_t slot) {
+      if (slot == query.slot) return;
+      unsigned d = slots_[slot].dense;
+      float gap = Gap(q, shape_.Rect(d));
+      clearance = std::min(clearance, gap);
+      if (gap <= 0) Gather(sc, d);
+    });
+    Attributes *hit = nullptr;
+    Narrow(sc, attrs_[qd], q, [&](unsigned d) {
+      if (!hit) hit = &attrs_[d];
+    });
+    last.mask = mask;
+    last.witness = Handle();
+    if (hit) {
+      unsigned slot = owner_[hit - attrs_.data()];
+      last.witness = { slot, slots_[slot].generation };
+    }
+    last.q = q;
+    last.clearance = hit ? 0 : clearance;
+    last.drift = Drift(mask);
+    last.epoch = Epoch(mask);
+    return hit;
+  }
+
+  /*
+   * Find every overlapping pair between colliders in mask_a and colliders
+   * in mask_b, in one pass. Writes up to max pairs to out and returns how
+   * many it wrote. A collider in both masks is never paired with itself,
+   * and two such colliders are only reported once. Two static colliders
+   * are never paired.
+   */
+  size_t QueryPairs(unsigned mask_a, unsigned mask_b, struct Pair *out, size_t max) {
+    struct Meter meter(*this);
+    size_t n = 0;
+    Bake();
+    /* Report ka/kb if they can pair up, oriented so a is the mask_a side */
+    auto emit = [&](size_t ka, size_t kb) {
+      if (IsStatic(ka) && IsStatic(kb)) return;
+      struct Attributes *a = &At(ka);
+      struct Attributes *b = &At(kb);
+      bool ab = (a->mask & mask_a) && (b->mask & mask_b);
+      bool ba = (b->mask & mask_a) && (a->mask & mask_b);
+      if (ab && ba) {
+        /* Either orientation works; only take the one with ka < kb */
+        if (kb < ka) std::swap(a, b);
+      } else if (!ab) {
+        if (!ba) return;
+        std::swap(a, b);
+      }
+      if (n < max && Tested(scratch_[0], Overlap(*a, *b)))
+        out[n++] = { a, b };
+    };
+    if (mode_ == kSweepAndPrune) {
+      /* The sweep already holds every pair whose bounds overlap, in key order */
+      sap_.ForPairs([&](SweepAndPrune::Pair p) {
+        if (n == max) return;
+        ++scratch_[0].tally.visited;
+        ++scratch_[0].tally.candidates;
+        emit(p.a, p.b);
+      });
+      return n;
+    }
+    /* Only moving colliders drive the search; statics are found from them */
+    size_t live = attrs_.size() - statics_;
+    if (!pool_ || live < kParallelMin) {
+      PairsInRange(statics_, attrs_.size(), mask_a, mask_b, scratch_[0], [&](struct Pair p) {
+        if (n == max) return false;
+        out[n++] = p;
+        return n < max;
+      });
+      return n;
+    }
+    /*
+     * Every job covers a fixed slice of the dense arrays and keeps its
+     * own results, and the slices are stitched back together in order,
+     * so the output is the same as the single-threaded one.
+     */
+    size_t jobs = pool_->Size() * 4;
+    size_t slice = (live + jobs - 1) / jobs;
+    if (found_.size() < jobs) found_.resize(jobs);
+    pool_->Run(jobs, [&](size_t job, unsigned worker) {
+      std::vector<struct Pair> &found = found_[job];
+      found.clear();
+      size_t begin = statics_ + std::min(job * slice, live);
+      size_t end = std::min(begin + slice, attrs_.size());
+      PairsInRange(begin, end, mask_a, mask_b, scratch_[worker], [&](struct Pair p) {
+        found.push_back(p);
+        return found.size() < max;
+      });
+    });
+    for (size_t j = 0; j < jobs && n < max; ++j)
+      for (size_t i = 0; i < found_[j].size() && n < max; ++i)
+        out[n++] = found_[j][i];
+    return n;
+  }
+
+  /*
+   * Spread QueryPairs over this many extra worker threads once there
+   * are enough colliders to make it worth it. 0 turns it back off.
+   */
+  void SetThreads(unsigned threads) {
+    pool_.reset(threads ? new WorkerPool(threads) : nullptr);
+    scratch_.resize(threads + 1);
+  }
+
+  /*
+   * What the collision work cost over one frame. A frame starts with
+   * Update() and runs up to the next one.
+   */
+  struct Stats {
+    /* Colliders the broadphase handed over; pairs, for the sweep */
+    size_t candidates = 0;
+    /* Exact shape tests run, and how many of them found an overlap */
+    size_t tests = 0;
+    size_t overlaps = 0;
+    /* Grid cells, tree nodes or sweep endpoints looked at */
+    size_t visited = 0;
+    /* Spent inside Collision calls; only timed while recording */
+    double microseconds = 0;
+  };
+  /*
+   * Keep the Stats of the last frames frames to read back with
+   * History() or DumpStats(). 0, the default, stops recording.
+   */
+  void RecordStats(size_t frames) {
+    history_.assign(frames, Stats());
+    recorded_ = 0;
+  }
+  /* Counters for the frame so far */
+  const struct Stats &FrameStats() { return frame_; }
+  /* Copies up to max of the latest recorded frames, oldest first; returns how many */
+  size_t History(struct Stats *out, size_t max) {
+    size_t n = std::min({ max, recorded_, history_.size() });
+    for (size_t i = 0; i < n; ++i)
+      out[i] = history_[(recorded_ - n + i) % history_.size()];
+    return n;
+  }
+  /* Every recorded frame, oldest first, one tab-separated line each */
+  void DumpStats(std::ostream &out) {
+    out << "frame\tcandidates\ttests\toverlaps\tvisited\tmicroseconds\n";
+    size_t n = std::min(recorded_, history_.size());
+    for (size_t i = 0; i < n; ++i) {
+      const struct Stats &f = history_[(recorded_ - n + i) % history_.size()];
+      out << recorded_ - n + i << '\t' << f.candidates << '\t' << f.tests << '\t'
+          << f.overlaps << '\t' << f.visited << '\t' << f.microseconds << '\n';
+    }
+  }
+
+  /*
+   * Move a circle of the given radius from "from" to "to" and find the
+   * first collider in mask it runs into. Returns that collider and sets
+   * toi to how far along the motion the contact happened, 0 to 1, or
+   * returns nullptr if the path is clear. Colliders are where the last
+   * Update() left them.
+   */
+  Attributes *SweepCircle(float radius, v2d from, v2d to, unsigned mask, float &toi) {
+    return Trace(from, to, radius, mask, toi);
+  }
+
+  /* What a ray or line ran into first */
+  struct RayHit {
+    struct Attributes *attr = nullptr;
+    /* How far along the ray, and where */
+    float distance = 0;
+    v2d point;
+  };
+  /* Cast a ray up to max_dist long; returns false if it hit nothing in mask */
+  bool Raycast(v2d origin, v2d dir, float max_dist, unsigned mask, struct RayHit &hit) {
+    return Linecast(origin, origin + dir.Normalized() * max_dist, mask, hit);
+  }
+  /* Same, for the segment between two points */
+  bool Linecast(v2d from, v2d to, unsigned mask, struct RayHit &hit) {
+    float t;
+    hit.attr = Trace(from, to, 0, mask, t);
+    if (!hit.attr) return false;
+    hit.distance = (to - from).Magnitude() * t;
+    hit.point = from + (to - from) * t;
+    return true;
+  }
+
+  /* A collider near a point, and how far its nearest edge is from it */
+  struct Nearby {
+    struct Attributes *attr;
+    float distance;
+  };
+  /*
+   * Colliders in mask within radius of center, nearest first, written
+   * to out. If more than max are in range only the nearest max are
+   * kept. Returns how many were written. Colliders are where the last
+   * Update() left them, and nothing is allocated.
+   */
+  size_t QueryRadius(v2d center, float radius, unsigned mask, struct Nearby *out, size_t max) {
+    struct Meter meter(*this);
+    Bake();
+    size_t n = 0;
+    if (max == 0) return 0;
+    /* Nothing lies outside reach_, so don't let the grid walk empty cells */
+    float x0 = std::max(center.x - radius, reach_.x);
+    float y0 = std::max(center.y - radius, reach_.y);
+    float x1 = std::min(center.x + radius, reach_.x + reach_.w);
+    float y1 = std::min(center.y + radius, reach_.y + reach_.h);
+    if (x0 > x1 || y0 > y1) return 0;
+    struct rect q = { x0, y0, x1 - x0, y1 - y0 };
+    struct Scratch &sc = scratch_[0];
+    Candidates(sc, q, mask, [&](size_t slot) {
+      float dist = DistanceTo(center, slots_[slot].dense);
+      if (Tested(sc, dist <= radius)) Keep(out, n, max, { &At(slot), dist });
+    });
+    return n;
+  }
+  /*
+   * The k colliders in mask nearest to center, nearest first, written
+   * to out. Returns fewer than k if there aren't that many. Searches a
+   * circle around center that doubles until the kth nearest is inside.
+   */
+  size_t QueryNearest(v2d center, size_t k, unsigned mask, struct Nearby *out) {
+    if (k == 0) return 0;
+    /* Past the farthest corner of reach_, the circle covers everything */
+    float dx = std::max(std::abs(center.x - reach_.x), std::abs(reach_.x + reach_.w - center.x));
+    float dy = std::max(std::abs(center.y - reach_.y), std::abs(reach_.y + reach_.h - center.y));
+    float far = std::sqrt(dx * dx + dy * dy);
+    for (float r = kNearestStart;; r *= 2) {
+      size_t n = QueryRadius(center, r, mask, out, k);
+      if ((n == k && out[k - 1].distance <= r) || r >= far) return n;
     }
-    return nullptr;
   }
 
   /* type-type overlap functions */
@@ -136,11 +1282,946 @@ class Collision {
            (pos1.y + h1) >= (pos2.y - h2);
   }
   bool CircleCircle(float r1, v2d pos1, float r2, v2d pos2) {
-    return pos1.Distance(pos2) < (r1 + r2);
+    return pos1.SqrDistance(pos2) < (r1 + r2) * (r1 + r2);
+  }
+  bool CircleAabb(float r1, v2d pos1, float w2, float h2, v2d pos2) {
+    float ox = std::max(std::abs(pos1.x - pos2.x) - w2, 0.0f);
+    float oy = std::max(std::abs(pos1.y - pos2.y) - h2, 0.0f);
+    return ox * ox + oy * oy < r1 * r1;
+  }
+
+  /*
+   * How two overlapping colliders touch. normal is a unit vector from
+   * a towards b, depth is how far b has to move along it (or a against
+   * it) for them to separate, and point is about the middle of the
+   * overlap.
+   */
+  struct Contact {
+    v2d normal;
+    float depth = 0;
+    v2d point;
+  };
+  /* Contact between two colliders at their current positions */
+  bool Collide(Handle a, Handle b, struct Contact &c) {
+    if (!Valid(a) || !Valid(b)) return false;
+    struct Pair p = { &attrs_[slots_[a.slot].dense], &attrs_[slots_[b.slot].dense] };
+    return Contacts(&p, 1, &c) == 1;
+  }
+  /*
+   * Contacts for n pairs, e.g. straight from QueryPairs; out[i] goes
+   * with pairs[i] and is left zeroed if they don't overlap. Returns how
+   * many do. Pairs are grouped by shape combination first and each
+   * group goes through its routine in one loop, so there's no switch
+   * per pair.
+   */
+  size_t Contacts(const struct Pair *pairs, size_t n, struct Contact *out) {
+    struct Meter meter(*this);
+    /* Counting sort pair indices by kind */
+    size_t start[kShapes * kShapes + 1] = {};
+    for (size_t i = 0; i < n; ++i)
+      ++start[Kind(pairs[i]) + 1];
+    for (size_t k = 0; k < kShapes * kShapes; ++k)
+      start[k + 1] += start[k];
+    size_t next[kShapes * kShapes];
+    std::copy(start, start + kShapes * kShapes, next);
+    if (order_.size() < n) order_.resize(n);
+    for (size_t i = 0; i < n; ++i)
+      order_[next[Kind(pairs[i])]++] = i;
+    size_t touching = 0;
+    for (size_t k = 0; k < kShapes * kShapes; ++k)
+      touching += kBatches[k](pairs, order_.data() + start[k], start[k + 1] - start[k], out);
+    scratch_[0].tally.tests += n;
+    scratch_[0].tally.overlaps += touching;
+    return touching;
   }
 
  private:
-  std::unordered_map<size_t, struct Attributes> map_;
+  /*
+   * The colliders on one layer bit, in whichever structure the mode
+   * picked. Keys are slot numbers.
+   */
+  class Layer {
+   public:
+    Layer(Broadphase mode, struct rect world) {
+      if (mode == kGrid) grid_.reset(new SpatialHash());
+      if (mode == kQuadtree) tree_.reset(new Quadtree<std::vector<QuadItem>>(0, world));
+      /* Events come from the all-layer sweep, so this one skips pairs */
+      if (mode == kSweepAndPrune) sap_.reset(new SweepAndPrune(false));
+    }
+    void Insert(size_t key, struct rect now) {
+      if (grid_) grid_->Insert(key, now);
+      if (tree_) tree_->Insert(key, now);
+      if (sap_) sap_->Insert(key, now);
+    }
+    void Move(size_t key, struct rect old, struct rect now) {
+      if (grid_) grid_->Move(key, now);
+      if (tree_) tree_->Move(key, old, now);
+      if (sap_) sap_->Move(key, now);
+    }
+    void Remove(size_t key, struct rect old) {
+      if (grid_) grid_->Remove(key);
+      if (tree_) tree_->Remove(key, old);
+      if (sap_) sap_->Remove(key);
+    }
+    size_t Sort() {
+      return sap_ ? sap_->Sort() : 0;
+    }
+    /* Both return how many cells, nodes or endpoints they went over */
+    template <typename F>
+    size_t Query(struct rect q, F &&visit) {
+      if (grid_) return grid_->Query(q, visit);
+      if (tree_) return tree_->Retrieve(q, visit);
+      return sap_->Query(q, visit);
+    }
+    /* Grid and tree only; the sweep has no notion of walking a segment */
+    template <typename F>
+    size_t Trace(v2d from, v2d d, float pad, float &best, F &&visit) {
+      if (grid_) return grid_->Trace(from, d, pad, best, visit);
+      if (tree_) return tree_->Trace(from, d, pad, best, visit);
+      return 0;
+    }
+
+   private:
+    std::unique_ptr<SpatialHash> grid_;
+    std::unique_ptr<Quadtree<std::vector<QuadItem>>> tree_;
+    std::unique_ptr<SweepAndPrune> sap_;
+  }; // class Layer
+
+  struct Slot {
+    /* Where the collider currently sits in the dense arrays */
+    unsigned dense;
+    unsigned generation;
+  };
+
+  /* Candidates gathered for the batch narrowphase, split by shape */
+  struct Scratch {
+    struct Columns circles;
+    struct Columns boxes;
+    /* Oriented boxes keep their own half extents plus their x axis */
+    struct Columns obbs;
+    std::vector<float> obb_ux;
+    std::vector<float> obb_uy;
+    std::vector<unsigned> circle_ids;
+    std::vector<unsigned> box_ids;
+    std::vector<unsigned> obb_ids;
+    std::vector<uint8_t> hits;
+    /* Counters picked up since the last Meter settled them */
+    struct Stats tally;
+
+    void Clear() {
+      circles.clear();
+      boxes.clear();
+      obbs.clear();
+      obb_ux.clear();
+      obb_uy.clear();
+      circle_ids.clear();
+      box_ids.clear();
+      obb_ids.clear();
+    }
+  };
+
+  /*
+   * Books the time until it goes out of scope, and whatever the
+   * scratch counters picked up meanwhile, to the current frame. Every
+   * public call that does collision work makes one.
+   */
+  class Meter {
+   public:
+    explicit Meter(Collision &c) : c_(c) {
+      if (!c_.history_.empty()) start_ = std::chrono::steady_clock::now();
+    }
+    ~Meter() {
+      struct Stats &f = c_.frame_;
+      for (struct Scratch &sc : c_.scratch_) {
+        f.candidates += sc.tally.candidates;
+        f.tests += sc.tally.tests;
+        f.overlaps += sc.tally.overlaps;
+        f.visited += sc.tally.visited;
+        sc.tally = Stats();
+      }
+      if (!c_.history_.empty())
+        f.microseconds += std::chrono::duration<double, std::micro>(
+          std::chrono::steady_clock::now() - start_
+        ).count();
+    }
+   private:
+    Collision &c_;
+    std::chrono::steady_clock::time_point start_;
+  }; // class Meter
+
+  /* Count one exact test on sc and pass its result through */
+  static bool Tested(struct Scratch &sc, bool hit) {
+    ++sc.tally.tests;
+    sc.tally.overlaps += hit;
+    return hit;
+  }
+
+  /*
+   * What the last CheckAgainst for a collider found: the collider it
+   * hit, or else how far the nearest one in mask was, so the next call
+   * can often skip the search.
+   */
+  struct Coherence {
+    unsigned mask = 0;
+    Handle witness;
+    /* The query's bounds then, and the gap around them on a miss */
+    struct rect q;
+    float clearance = 0;
+    /* Drift() and Epoch() for mask at the time */
+    double drift = 0;
+    size_t epoch = 0;
+  };
+
+  /* First search radius for QueryNearest */
+  static constexpr float kNearestStart = 32;
+  /* How far past its bounds CheckAgainst measures clearance on a miss */
+  static constexpr float kClearance = 16;
+
+  /* Below this many colliders QueryPairs isn't worth splitting up */
+  static const size_t kParallelMin = 4096;
+
+  bool Valid(Handle h) {
+    return h.slot < slots_.size() && h.generation != 0 &&
+           slots_[h.slot].generation == h.generation;
+  }
+  struct Attributes &At(size_t slot) {
+    return attrs_[slots_[slot].dense];
+  }
+  bool IsStatic(size_t slot) const {
+    return slots_[slot].dense < statics_;
+  }
+  /* Trade places in the dense arrays and repoint both slots */
+  void Swap(unsigned i, unsigned j) {
+    if (i == j) return;
+    std::swap(attrs_[i], attrs_[j]);
+    std::swap(owner_[i], owner_[j]);
+    shape_.Swap(i, j);
+    slots_[owner_[i]].dense = i;
+    slots_[owner_[j]].dense = j;
+  }
+
+  /*
+   * Earliest t in [0, 1] at which from + (to - from) * t is within r of
+   * c. Starting inside counts as t = 0.
+   */
+  static bool SegmentCircle(v2d from, v2d to, v2d c, float r, float &t) {
+    v2d d = to - from;
+    v2d m = from - c;
+    float cc = m.SqrMagnitude() - r * r;
+    if (cc <= 0) {
+      t = 0;
+      return true;
+    }
+    float a = d.SqrMagnitude();
+    float b = m.Dot(d);
+    float disc = b * b - a * cc;
+    /* Not moving, moving away, or passing by */
+    if (a == 0 || b >= 0 || disc < 0) return false;
+    t = (-b - std::sqrt(disc)) / a;
+    return t <= 1;
+  }
+  /*
+   * Same, for a box of half extents w, h grown by r with rounded
+   * corners, i.e. everywhere a circle of radius r touches the box.
+   */
+  static bool SegmentRoundedBox(v2d from, v2d to, v2d c, float w, float h, float r, float &t) {
+    v2d d = to - from;
+    /* Slab test against the square-cornered box first */
+    float t0;
+    if (!SegmentEntersRect(from, d, { c.x - w, c.y - h, w * 2, h * 2 }, r, t0))
+      return false;
+    /*
+     * If we came in through a corner square, the rounded corner is
+     * the only part of it that counts, so test that circle instead
+     */
+    v2d at = from + d * t0;
+    bool past_x = at.x < c.x - w || at.x > c.x + w;
+    bool past_y = at.y < c.y - h || at.y > c.y + h;
+    if (past_x && past_y) {
+      v2d corner = { at.x < c.x ? c.x - w : c.x + w, at.y < c.y ? c.y - h : c.y + h };
+      return SegmentCircle(from, to, corner, r, t);
+    }
+    t = t0;
+    return true;
+  }
+
+  /*
+   * Earliest collider in mask that a circle of the given radius touches
+   * while moving from "from" to "to". Walks the grid or tree along the
+   * segment so only colliders near it get tested.
+   */
+  Attributes *Trace(v2d from, v2d to, float radius, unsigned mask, float &toi) {
+    struct Meter meter(*this);
+    struct Scratch &sc = scratch_[0];
+    Attributes *first = nullptr;
+    toi = 1.0;
+    Bake();
+    auto test = [&](size_t slot) {
+      unsigned d = slots_[slot].dense;
+      if ((attrs_[d].mask & mask) == 0) return;
+      float t;
+      v2d c = { shape_.x[d], shape_.y[d] };
+      bool hit;
+      if (attrs_[d].type == Attributes::Circle) {
+        hit = SegmentCircle(from, to, c, shape_.ex[d] + radius, t);
+      } else if (attrs_[d].type == Attributes::AABB) {
+        hit = SegmentRoundedBox(from, to, c, shape_.ex[d], shape_.ey[d], radius, t);
+      } else {
+        /* Into the box's frame, where it's axis-aligned; t stays the same */
+        v2d u = Axis(attrs_[d]), v = { -u.y, u.x };
+        v2d f = from - c, e = to - c;
+        hit = SegmentRoundedBox(
+          { f.Dot(u), f.Dot(v) }, { e.Dot(u), e.Dot(v) }, { 0, 0 },
+          attrs_[d].traits.w, attrs_[d].traits.h, radius, t
+        );
+      }
+      /* Ties go to the lower slot so the answer doesn't depend on walk order */
+      if (Tested(sc, hit) && (!first || t < toi || (t == toi && slot < owner_[first - attrs_.data()]))) {
+        first = &attrs_[d];
+        toi = t;
+      }
+    };
+    v2d d = to - from;
+    if (mode_ != kSweepAndPrune) {
+      /* Each layer's walk stops at the best hit of the ones before it */
+      float best = 1.0;
+      auto visit = [&](size_t slot) {
+        ++sc.tally.candidates;
+        test(slot);
+        if (first) best = toi;
+      };
+      ForLayers(mask, [&](unsigned, class Layer &layer) {
+        sc.tally.visited += layer.Trace(from, d, radius, best, visit);
+      });
+      sc.tally.visited += baked_.Trace(from, d, radius, mask, best, visit);
+    } else {
+      struct rect swept = {
+        std::min(from.x, to.x) - radius,
+        std::min(from.y, to.y) - radius,
+        std::abs(d.x) + radius * 2,
+        std::abs(d.y) + radius * 2
+      };
+      Candidates(sc, swept, mask, test);
+    }
+    if (!first) toi = 1.0;
+    return first;
+  }
+
+  /* How far p is from the collider at dense index d; 0 if inside it */
+  float DistanceTo(v2d p, size_t d) {
+    float dx = p.x - shape_.x[d], dy = p.y - shape_.y[d];
+    const struct Attributes &attr = attrs_[d];
+    if (attr.type == Attributes::Circle)
+      return std::max(std::sqrt(dx * dx + dy * dy) - shape_.ex[d], 0.0f);
+    float w = shape_.ex[d], h = shape_.ey[d];
+    if (attr.type == Attributes::OBB) {
+      v2d u = Axis(attr);
+      float lx = dx * u.x + dy * u.y;
+      dy = dy * u.x - dx * u.y;
+      dx = lx;
+      w = attr.traits.w;
+      h = attr.traits.h;
+    }
+    float ox = std::max(std::abs(dx) - w, 0.0f);
+    float oy = std::max(std::abs(dy) - h, 0.0f);
+    return std::sqrt(ox * ox + oy * oy);
+  }
+  /* Insert into the sorted list out[0, n) if it's among the nearest max */
+  void Keep(struct Nearby *out, size_t &n, size_t max, struct Nearby item) {
+    /* Ties go to the lower slot so the order doesn't depend on walk order */
+    auto before = [&](const struct Nearby &l, const struct Nearby &r) {
+      return l.distance < r.distance || (l.distance == r.distance &&
+        owner_[l.attr - attrs_.data()] < owner_[r.attr - attrs_.data()]);
+    };
+    if (n == max && !before(item, out[n - 1])) return;
+    size_t i = n < max ? n++ : n - 1;
+    for (; i > 0 && before(item, out[i - 1]); --i)
+      out[i] = out[i - 1];
+    out[i] = item;
+  }
+  /*
+   * Gap between two boxes along whichever axis they're furthest apart
+   * on; 0 or less if they overlap. Moving an edge by some distance
+   * changes it by at most that much.
+   */
+  static float Gap(struct rect a, struct rect b) {
+    return std::max({
+      a.x - (b.x + b.w), b.x - (a.x + a.w),
+      a.y - (b.y + b.h), b.y - (a.y + a.h)
+    });
+  }
+  /* Furthest any edge moved going from box a to box b */
+  static float Shift(struct rect a, struct rect b) {
+    return std::max({
+      std::abs(a.x - b.x), std::abs(a.x + a.w - b.x - b.w),
+      std::abs(a.y - b.y), std::abs(a.y + a.h - b.y - b.h)
+    });
+  }
+  /*
+   * Summed over the layers in mask: how far their colliders' edges may
+   * have moved in total, and how many colliders have joined, since the
+   * Collision was made. Only ever grow.
+   */
+  double Drift(unsigned mask) {
+    double total = 0;
+    for (unsigned bits = mask; bits; bits &= bits - 1)
+      total += drift_[__builtin_ctz(bits)];
+    return total;
+  }
+  size_t Epoch(unsigned mask) {
+    size_t total = 0;
+    for (unsigned bits = mask; bits; bits &= bits - 1)
+      total += epoch_[__builtin_ctz(bits)];
+    return total;
+  }
+  /* Grow reach_ to cover r */
+  void Reach(struct rect r) {
+    if (reach_.w < 0) {
+      reach_ = r;
+      return;
+    }
+    float x1 = std::max(reach_.x + reach_.w, r.x + r.w);
+    float y1 = std::max(reach_.y + reach_.h, r.y + r.h);
+    reach_.x = std::min(reach_.x, r.x);
+    reach_.y = std::min(reach_.y, r.y);
+    reach_.w = x1 - reach_.x;
+    reach_.h = y1 - reach_.y;
+  }
+
+  /* Axis-aligned box around a collider at its current position */
+  static struct rect Bounds(const struct Attributes &attr) {
+    v2d p = attr.obj->pos;
+    float hw = attr.type == Attributes::Circle ? attr.traits.r : attr.traits.w;
+    float hh = attr.type == Attributes::Circle ? attr.traits.r : attr.traits.h;
+    if (attr.type == Attributes::OBB) {
+      v2d u = Axis(attr);
+      float ax = std::abs(u.x), ay = std::abs(u.y);
+      float w = hw;
+      hw = w * ax + hh * ay;
+      hh = w * ay + hh * ax;
+    }
+    return { p.x - hw, p.y - hh, hw * 2, hh * 2 };
+  }
+  /* An OBB's x axis, turned so its (w, h) corner points along point_at */
+  static v2d Axis(const struct Attributes &attr) {
+    v2d p = v2d(attr.point_at).Normalized();
+    v2d c = v2d(attr.traits.w, attr.traits.h).Normalized();
+    if (p.SqrMagnitude() == 0 || c.SqrMagnitude() == 0) return v2d(1, 0);
+    return v2d(p.x * c.x + p.y * c.y, p.y * c.x - p.x * c.y);
+  }
+  /* Any box as an oriented one; AABBs just get the world x axis */
+  struct Box {
+    v2d c;
+    float w;
+    float h;
+    v2d u;
+  };
+  static struct Box AsBox(const struct Attributes &attr) {
+    v2d u = attr.type == Attributes::OBB ? Axis(attr) : v2d(1, 0);
+    return { attr.obj->pos, attr.traits.w, attr.traits.h, u };
+  }
+  /* Call appropriate overlap function */
+  bool Overlap(const struct Attributes &at, const struct Attributes &bt) {
+    if (at.type == Attributes::AABB && bt.type == Attributes::AABB)
+      return AabbAabb(
+        at.traits.w, at.traits.h, at.obj->pos,
+        bt.traits.w, bt.traits.h, bt.obj->pos
+      );
+    if (at.type == Attributes::Circle && bt.type == Attributes::Circle)
+      return CircleCircle(
+        at.traits.r, at.obj->pos,
+        bt.traits.r, bt.obj->pos
+      );
+    if (at.type == Attributes::OBB || bt.type == Attributes::OBB) {
+      /* Same kernels as the batch narrowphase, one lane wide */
+      const struct Attributes &o = at.type == Attributes::OBB ? at : bt;
+      const struct Attributes &p = at.type == Attributes::OBB ? bt : at;
+      struct Box q = AsBox(o), b = AsBox(p);
+      uint8_t hit;
+      if (p.type == Attributes::Circle)
+        simd::ObbCircleScalar(
+          q.c.x, q.c.y, q.w, q.h, q.u.x, q.u.y, &b.c.x, &b.c.y, &p.traits.r, 1, &hit
+        );
+      else
+        simd::ObbObbScalar(
+          q.c.x, q.c.y, q.w, q.h, q.u.x, q.u.y,
+          &b.c.x, &b.c.y, &b.w, &b.h, &b.u.x, &b.u.y, 1, &hit
+        );
+      return hit;
+    }
+    if (at.type == Attributes::Circle)
+      return CircleAabb(at.traits.r, at.obj->pos, bt.traits.w, bt.traits.h, bt.obj->pos);
+    return CircleAabb(bt.traits.r, bt.obj->pos, at.traits.w, at.traits.h, at.obj->pos);
+  }
+
+  /*
+   * Contact generators, one per shape combination, each for a single
+   * pair. They fill in c and return true if a and b overlap.
+   */
+  typedef bool (*ContactFn)(const struct Attributes &, const struct Attributes &, struct Contact &);
+  static bool CircleCircleContact(
+    const struct Attributes &a, const struct Attributes &b, struct Contact &c
+  ) {
+    v2d pa = a.obj->pos;
+    v2d d = b.obj->pos - pa;
+    float r = a.traits.r + b.traits.r;
+    float d2 = d.SqrMagnitude();
+    if (d2 >= r * r) return false;
+    float dist = std::sqrt(d2);
+    /* Same centers; any direction will do */
+    c.normal = dist > 0 ? d / dist : v2d(1, 0);
+    c.depth = r - dist;
+    c.point = pa + c.normal * (a.traits.r - c.depth / 2);
+    return true;
+  }
+  static bool AabbAabbContact(
+    const struct Attributes &a, const struct Attributes &b, struct Contact &c
+  ) {
+    v2d pa = a.obj->pos, pb = b.obj->pos;
+    float dx = pb.x - pa.x, dy = pb.y - pa.y;
+    float ox = a.traits.w + b.traits.w - std::abs(dx);
+    float oy = a.traits.h + b.traits.h - std::abs(dy);
+    if (ox < 0 || oy < 0) return false;
+    /* Push out along whichever axis is the shorter way out */
+    if (ox < oy) {
+      c.normal = v2d(dx < 0 ? -1 : 1, 0);
+      c.depth = ox;
+    } else {
+      c.normal = v2d(0, dy < 0 ? -1 : 1);
+      c.depth = oy;
+    }
+    float x0 = std::max(pa.x - a.traits.w, pb.x - b.traits.w);
+    float x1 = std::min(pa.x + a.traits.w, pb.x + b.traits.w);
+    float y0 = std::max(pa.y - a.traits.h, pb.y - b.traits.h);
+    float y1 = std::min(pa.y + a.traits.h, pb.y + b.traits.h);
+    c.point = v2d((x0 + x1) / 2, (y0 + y1) / 2);
+    return true;
+  }
+  /* Works in the box's own frame, so it covers AABBs and OBBs alike */
+  static bool CircleBoxContact(
+    const struct Attributes &a, const struct Attributes &b, struct Contact &c
+  ) {
+    struct Box box = AsBox(b);
+    v2d u = box.u, v = { -u.y, u.x };
+    v2d rel = a.obj->pos - box.c;
+    float w = box.w, h = box.h, r = a.traits.r;
+    float dx = rel.Dot(u), dy = rel.Dot(v);
+    v2d normal, point;
+    if (std::abs(dx) <= w && std::abs(dy) <= h) {
+      /* Center inside the box: out through the nearest side */
+      float fx = w - std::abs(dx), fy = h - std::abs(dy);
+      if (fx < fy) {
+        normal = v2d(dx < 0 ? 1 : -1, 0);
+        c.depth = r + fx;
+        point = v2d(-normal.x * w, dy);
+      } else {
+        normal = v2d(0, dy < 0 ? 1 : -1);
+        c.depth = r + fy;
+        point = v2d(dx, -normal.y * h);
+      }
+    } else {
+      point = v2d(std::clamp(dx, -w, w), std::clamp(dy, -h, h));
+      v2d d = point - v2d(dx, dy);
+      float d2 = d.SqrMagnitude();
+      if (d2 >= r * r) return false;
+      float dist = std::sqrt(d2);
+      normal = d / dist;
+      c.depth = r - dist;
+    }
+    /* Back out to world space */
+    c.normal = u * normal.x + v * normal.y;
+    c.point = box.c + u * point.x + v * point.y;
+    return true;
+  }
+  static bool BoxCircleContact(
+    const struct Attributes &a, const struct Attributes &b, struct Contact &c
+  ) {
+    if (!CircleBoxContact(b, a, c)) return false;
+    c.normal = -c.normal;
+    return true;
+  }
+  /*
+   * Separating axes for two boxes, either of them oriented. The axis
+   * with the least overlap is the normal; the contact point is the
+   * middle of b's face or corner that reaches furthest into a, pushed
+   * back by half the depth.
+   */
+  static bool BoxBoxContact(
+    const struct Attributes &a, const struct Attributes &b, struct Contact &c
+  ) {
+    struct Box ba = AsBox(a), bb = AsBox(b);
+    v2d d = bb.c - ba.c;
+    v2d axes[4] = {
+      ba.u, { -ba.u.y, ba.u.x },
+      bb.u, { -bb.u.y, bb.u.x }
+    };
+    auto reach = [](struct Box box, v2d n) {
+      return box.w * std::abs(box.u.Dot(n)) + box.h * std::abs(box.u.Cross(n));
+    };
+    float depth = 0;
+    v2d normal;
+    for (int i = 0; i < 4; ++i) {
+      float dn = d.Dot(axes[i]);
+      float overlap = reach(ba, axes[i]) + reach(bb, axes[i]) - std::abs(dn);
+      if (overlap < 0) return false;
+      if (i == 0 || overlap < depth) {
+        depth = overlap;
+        normal = dn < 0 ? -axes[i] : axes[i];
+      }
+    }
+    /* b's corners furthest back along the normal */
+    v2d bu = bb.u * bb.w, bv = v2d(-bb.u.y, bb.u.x) * bb.h;
+    v2d corners[4] = { bu + bv, bu - bv, -bu + bv, -bu - bv };
+    float least = corners[0].Dot(normal);
+    for (v2d &k : corners) least = std::min(least, k.Dot(normal));
+    v2d deepest;
+    int count = 0;
+    for (v2d &k : corners) {
+      if (k.Dot(normal) > least + 1e-3f * (bb.w + bb.h)) continue;
+      deepest += k;
+      ++count;
+    }
+    c.normal = normal;
+    c.depth = depth;
+    c.point = bb.c + deepest / (float)count + normal * (depth / 2);
+    return true;
+  }
+
+  /* Run one generator over a whole group of pairs */
+  template <ContactFn F>
+  static size_t ContactBatch(
+    const struct Pair *pairs, const size_t *idx, size_t n, struct Contact *out
+  ) {
+    size_t touching = 0;
+    for (size_t k = 0; k < n; ++k) {
+      const struct Pair &p = pairs[idx[k]];
+      out[idx[k]] = Contact();
+      touching += F(*p.a, *p.b, out[idx[k]]);
+    }
+    return touching;
+  }
+  typedef size_t (*BatchFn)(const struct Pair *, const size_t *, size_t, struct Contact *);
+  static const size_t kShapes = 3;
+  static size_t Kind(const struct Pair &p) {
+    return p.a->type * kShapes + p.b->type;
+  }
+  /* Indexed by Kind() */
+  static constexpr BatchFn kBatches[kShapes * kShapes] = {
+    ContactBatch<AabbAabbContact>,
+    ContactBatch<BoxCircleContact>,
+    ContactBatch<BoxBoxContact>,
+    ContactBatch<CircleBoxContact>,
+    ContactBatch<CircleCircleContact>,
+    ContactBatch<CircleBoxContact>,
+    ContactBatch<BoxBoxContact>,
+    ContactBatch<BoxCircleContact>,
+    ContactBatch<BoxBoxContact>
+  };
+
+  /*
+   * Pairs for the moving colliders at dense indices [begin, end), handed
+   * to sink one at a time until it returns false. Pairs with a static
+   * collider are found from the moving one, whichever side it is on.
+   * Only reads shared state, so several threads can run it at once with
+   * their own scratch.
+   */
+  template <typename F>
+  void PairsInRange(
+    size_t begin, size_t end, unsigned mask_a, unsigned mask_b,
+    struct Scratch &sc, F &&sink
+  ) {
+    bool more = true;
+    for (size_t d = begin; d < end && more; ++d) {
+      size_t slot = owner_[d];
+      bool in_a = attrs_[d].mask & mask_a;
+      bool in_b = attrs_[d].mask & mask_b;
+      if (in_a) {
+        /* Collect this collider's partners, then test them as one batch */
+        sc.Clear();
+        Candidates(sc, shape_.Rect(d), mask_b, [&](size_t other) {
+          if (other == slot) return;
+          struct Attributes &b = At(other);
+          /* Moving colliders in both masks would otherwise pair up twice */
+          if (!IsStatic(other) && (b.mask & mask_a) && in_b && other < slot) return;
+          Gather(sc, slots_[other].dense);
+        });
+        Narrow(sc, attrs_[d], shape_.Rect(d), [&](unsigned e) {
+          if (more) more = sink({ &attrs_[d], &attrs_[e] });
+        });
+      }
+      if (!in_b || !more) continue;
+      /* Statics on the mask_a side never look for partners themselves */
+      sc.Clear();
+      sc.tally.visited += baked_.Query(shape_.Rect(d), mask_a, [&](size_t other) {
+        ++sc.tally.candidates;
+        if (in_a && (At(other).mask & mask_b)) return;
+        Gather(sc, slots_[other].dense);
+      });
+      Narrow(sc, attrs_[d], shape_.Rect(d), [&](unsigned e) {
+        if (more) more = sink({ &attrs_[e], &attrs_[d] });
+      });
+    }
+  }
+
+  /* Queue up the collider at dense index d for the next Narrow() */
+  void Gather(struct Scratch &sc, unsigned d) {
+    struct rect r = shape_.Rect(d);
+    if (attrs_[d].type == Attributes::Circle) {
+      sc.circles.push_back(r);
+      sc.circle_ids.push_back(d);
+    } else if (attrs_[d].type == Attributes::AABB) {
+      sc.boxes.push_back(r);
+      sc.box_ids.push_back(d);
+    } else {
+      float w = attrs_[d].traits.w, h = attrs_[d].traits.h;
+      v2d u = Axis(attrs_[d]);
+      sc.obbs.push_back({ shape_.x[d] - w, shape_.y[d] - h, w * 2, h * 2 });
+      sc.obb_ux.push_back(u.x);
+      sc.obb_uy.push_back(u.y);
+      sc.obb_ids.push_back(d);
+    }
+  }
+  /*
+   * Test a query shape against everything gathered, a whole batch per
+   * kernel call, and call visit(d) for each hit: circles, then boxes,
+   * then oriented boxes, each in gather order. q is the query's
+   * bounds; an OBB query takes its extents and axis from qa.
+   */
+  template <typename F>
+  void Narrow(struct Scratch &sc, const struct Attributes &qa, struct rect q, F &&visit) {
+    float qx = q.x + q.w / 2, qy = q.y + q.h / 2;
+    float hw = q.w / 2, hh = q.h / 2;
+    v2d u = { 1, 0 };
+    if (qa.type == Attributes::OBB) {
+      hw = qa.traits.w;
+      hh = qa.traits.h;
+      u = Axis(qa);
+    }
+    bool circle = qa.type == Attributes::Circle;
+    bool aabb = qa.type == Attributes::AABB;
+    std::vector<uint8_t> &hits = sc.hits;
+    size_t most = std::max({ sc.circles.size(), sc.boxes.size(), sc.obbs.size() });
+    if (hits.size() < most) hits.resize(most);
+    auto report = [&](size_t n, size_t count, const std::vector<unsigned> &ids) {
+      for (size_t i = 0; i < n && count > 0; ++i) {
+        if (!hits[i]) continue;
+        visit(ids[i]);
+        --count;
+      }
+    };
+    const struct Columns &c = sc.circles;
+    if (c.size() > 0) {
+      size_t count = circle ?
+        simd::CircleCircle(qx, qy, hw, c.x.data(), c.y.data(), c.ex.data(), c.size(), hits.data()) :
+        aabb ?
+        simd::AabbCircle(qx, qy, hw, hh, c.x.data(), c.y.data(), c.ex.data(), c.size(), hits.data()) :
+        simd::ObbCircle(
+          qx, qy, hw, hh, u.x, u.y, c.x.data(), c.y.data(), c.ex.data(), c.size(), hits.data()
+        );
+      sc.tally.tests += c.size();
+      sc.tally.overlaps += count;
+      report(c.size(), count, sc.circle_ids);
+    }
+    const struct Columns &b = sc.boxes;
+    if (b.size() > 0) {
+      size_t count = circle ?
+        simd::CircleAabb(
+          qx, qy, hw, b.x.data(), b.y.data(), b.ex.data(), b.ey.data(), b.size(), hits.data()
+        ) :
+        aabb ?
+        simd::AabbAabb(
+          qx, qy, hw, hh, b.x.data(), b.y.data(), b.ex.data(), b.ey.data(), b.size(), hits.data()
+        ) :
+        simd::ObbAabb(
+          qx, qy, hw, hh, u.x, u.y,
+          b.x.data(), b.y.data(), b.ex.data(), b.ey.data(), b.size(), hits.data()
+        );
+      sc.tally.tests += b.size();
+      sc.tally.overlaps += count;
+      report(b.size(), count, sc.box_ids);
+    }
+    const struct Columns &o = sc.obbs;
+    if (o.size() > 0) {
+      size_t count = circle ?
+        simd::CircleObb(
+          qx, qy, hw, o.x.data(), o.y.data(), o.ex.data(), o.ey.data(),
+          sc.obb_ux.data(), sc.obb_uy.data(), o.size(), hits.data()
+        ) :
+        simd::ObbObb(
+          qx, qy, hw, hh, u.x, u.y, o.x.data(), o.y.data(), o.ex.data(), o.ey.data(),
+          sc.obb_ux.data(), sc.obb_uy.data(), o.size(), hits.data()
+        );
+      sc.tally.tests += o.size();
+      sc.tally.overlaps += count;
+      report(o.size(), count, sc.obb_ids);
+    }
+  }
+
+
+
+  /* Broadphase bookkeeping, dispatched on mode_; keys are slot numbers */
+  void Index(size_t slot, struct rect now) {
+    Reach(now);
+    if (mode_ == kSweepAndPrune) sap_.Insert(slot, now);
+    if (IsStatic(slot)) {
+      rebake_ = true;
+      return;
+    }
+    unsigned mask = At(slot).mask;
+    for (unsigned bits = mask; bits; bits &= bits - 1) {
+      std::unique_ptr<class Layer> &layer = layers_[__builtin_ctz(bits)];
+      if (!layer) layer.reset(new Layer(mode_, world_));
+      layer->Insert(slot, now);
+    }
+  }
+  void Reindex(size_t slot, size_t d, struct rect now) {
+    struct rect old = shape_.Rect(d);
+    /*
+     * Index the rect as Rect() gives it back, not as passed in: the
+     * centre and half-size round trip can move an edge by an ulp, and
+     * the broadphase has to be handed the same rect to find it again
+     */
+    shape_.Set(d, now);
+    now = shape_.Rect(d);
+    if (old.x == now.x && old.y == now.y && old.w == now.w && old.h == now.h)
+      return;
+    Reach(now);
+    float shift = Shift(old, now);
+    ForLayers(attrs_[d].mask, [&](unsigned bit, class Layer &layer) {
+      layer.Move(slot, old, now);
+      moved_[bit] = std::max(moved_[bit], shift);
+    });
+    if (mode_ == kSweepAndPrune) sap_.Move(slot, now);
+  }
+  void Deindex(size_t slot) {
+    if (mode_ == kSweepAndPrune) {
+      sap_.Remove(slot);
+      /* The collider is about to go away, so report its pairs now */
+      for (SweepAndPrune::Pair &p : sap_.Lost())
+        unregistered_.push_back({ At(p.a), At(p.b) });
+      sap_.Lost().clear();
+    }
+    if (IsStatic(slot)) {
+      rebake_ = true;
+      return;
+    }
+    struct rect old = shape_.Rect(slots_[slot].dense);
+    ForLayers(At(slot).mask, [&](unsigned, class Layer &layer) {
+      layer.Remove(slot, old);
+    });
+  }
+  /* Call fn(bit, layer) for each layer in mask that has ever had a collider */
+  template <typename F>
+  void ForLayers(unsigned mask, F &&fn) {
+    for (unsigned bits = mask; bits; bits &= bits - 1) {
+      unsigned bit = __builtin_ctz(bits);
+      if (layers_[bit]) fn(bit, *layers_[bit]);
+    }
+  }
+  /*
+   * Every collider in mask whose bounds overlap the query, once each.
+   * Only the layers in mask get looked at. A collider on several of
+   * them is left to the lowest one. The walk is counted on sc.
+   */
+  template <typename F>
+  void Candidates(struct Scratch &sc, struct rect query, unsigned mask, F &&visit) {
+    auto counted = [&](size_t slot) {
+      ++sc.tally.candidates;
+      visit(slot);
+    };
+    ForLayers(mask, [&](unsigned bit, class Layer &layer) {
+      unsigned below = mask & ((1u << bit) - 1);
+      sc.tally.visited += layer.Query(query, [&](size_t slot) {
+        if ((At(slot).mask & below) == 0) counted(slot);
+      });
+    });
+    sc.tally.visited += baked_.Query(query, mask, counted);
+  }
+  /* Rebuild the static tree if statics came or went since the last build */
+  void Bake() {
+    if (!rebake_) return;
+    std::vector<StaticTree::Item> items(statics_);
+    for (size_t d = 0; d < statics_; ++d)
+      items[d] = { owner_[d], shape_.Rect(d), attrs_[d].mask };
+    baked_.Build(std::move(items));
+    rebake_ = false;
+  }
+  /* Re-sort the sweep axis and turn pair changes into events */
+  void Track() {
+    began_.clear();
+    /* Pairs broken up by Unregister() since the last frame end too */
+    ended_.swap(unregistered_);
+    unregistered_.clear();
+    struct Scratch &sc = scratch_[0];
+    sc.tally.visited += sap_.Sort();
+    for (SweepAndPrune::Pair &p : sap_.Lost())
+      ended_.push_back({ At(p.a), At(p.b) });
+    sap_.Lost().clear();
+    /* Pairs where neither collider moved still touch the way they did */
+    for (size_t key : sap_.MovedKeys()) {
+      for (const SweepAndPrune::Partner &p : sap_.Partners(key)) {
+        ++sc.tally.visited;
+        /* Both moved: test it once, from the lower key */
+        if (sap_.WasMoved(p.key) && p.key < key) continue;
+        ++sc.tally.candidates;
+        if (IsStatic(key) && IsStatic(p.key)) continue;
+        bool &touching = sap_.Touching(key, p.key);
+        bool now = Tested(sc, Overlap(At(key), At(p.key)));
+        if (now != touching) {
+          size_t a = std::min(key, p.key), b = std::max(key, p.key);
+          (now ? began_ : ended_).push_back({ At(a), At(b) });
+        }
+        touching = now;
+      }
+    }
+    sap_.ClearMoved();
+  }
+
+  /* Handle slots, and the ones free for reuse */
+  std::vector<struct Slot> slots_;
+  std::vector<unsigned> free_;
+  /* Packed collider data; owner_ maps back from dense index to slot */
+  std::vector<struct Attributes> attrs_;
+  std::vector<unsigned> owner_;
+  /* Shape of each collider as of the last Update(), column-wise */
+  struct Columns shape_;
+  /* The first statics_ dense entries are static, baked into baked_ */
+  size_t statics_ = 0;
+  StaticTree baked_;
+  bool rebake_ = false;
+  /* Covers every box ever indexed; w < 0 until the first */
+  struct rect reach_ = { 0, 0, -1, -1 };
+
+  /* One set of narrowphase scratch per worker, the caller's first */
+  std::vector<struct Scratch> scratch_ = std::vector<struct Scratch>(1);
+  std::unique_ptr<WorkerPool> pool_;
+  /* Counters for the frame in progress, and a ring of finished ones */
+  struct Stats frame_;
+  std::vector<struct Stats> history_;
+  size_t recorded_ = 0;
+  /* Per-job QueryPairs results, merged in job order */
+  std::vector<std::vector<struct Pair>> found_;
+  /* Contacts() pair indices, grouped by shape combination */
+  std::vector<size_t> order_;
+
+  Broadphase mode_;
+  struct rect world_;
+  /* One bucket per layer bit, made when the first collider lands in it */
+  std::unique_ptr<class Layer> layers_[32];
+  /*
+   * Per layer bit: the furthest a collider moved this Update(), that
+   * summed over every Update() so far, and how many have registered
+   */
+  float moved_[32] = {};
+  double drift_[32] = {};
+  size_t epoch_[32] = {};
+  /* Per slot, what its last CheckAgainst found */
+  std::vector<struct Coherence> coherence_;
+  /* Every collider, for pair tracking in kSweepAndPrune mode */
+  SweepAndPrune sap_;
+  std::vector<struct Event> began_;
+  std::vector<struct Event> ended_;
+  std::vector<struct Event> unregistered_;
 }; // class Collision
 
 #endif
\ No newline at end of file
@@ -0,0 +1,51 @@
+#ifndef PACKER_H
+#define PACKER_H
+
+#include <vector>
+
+/*
+ * Places rectangles in a fixed size square, for packing images into
+ * an atlas texture. Rectangles go left to right along shelves, each
+ * as tall as the first thing put on it, stacked top to bottom. A
+ * rectangle goes on the flattest shelf it fits on, so short things
+ * don't waste the space next to tall ones. Nothing is ever removed.
+ */
+class ShelfPacker {
+ public:
+  /* padding is left clear right of and below every rectangle */
+  explicit ShelfPacker(int size, int padding = 1) : size_(size), padding_(padding) {}
+
+  /* Where a w by h rectangle goes, in x and y; false if it doesn't fit */
+  bool Pack(int w, int h, int &x, int &y) {
+    w += padding_;
+    h += padding_;
+    struct Shelf *best = nullptr;
+    for (struct Shelf &s : shelves_)
+      if (h <= s.h && s.used + w <= size_ && (!best || s.h < best->h))
+        best = &s;
+    if (!best) {
+      int top = shelves_.empty() ? 0 : shelves_.back().y + shelves_.back().h;
+      if (w > size_ || top + h > size_) return false;
+      shelves_.push_back({ top, h, 0 });
+      best = &shelves_.back();
+    }
+    x = best->used;
+    y = best->y;
+    best->used += w;
+    return true;
+  }
+  int Size() const { return size_; }
+
+ private:
+  struct Shelf {
+    int y;
+    int h;
+    /* Width taken so far, from the left */
+    int used;
+  };
+  std::vector<struct Shelf> shelves_;
+  int size_;
+  int padding_;
+}; // class ShelfPacker
+
+#endif
@@ -4,6 +4,9 @@
 #include <SDL2/SDL.h>
 #include <SDL2/SDL_image.h>
 
+#include <cmath>
+#include <vector>
+
 #include "input.h"
 
 namespace sdl {
@@ -13,6 +16,8 @@ SDL_Renderer *sdl_renderer;
 SDL_Window *sdl_window;
 const int kWindowX = 768;
 const int kWindowY = 432;
+/* Set by GetEvents when what's in the window may have been lost */
+bool window_exposed = true;
 
 /* EventToInput encapsulates translation of events from event loop
  * into the Input struct. Disentangles our input system from that of
@@ -134,6 +139,14 @@ int GetEvents(Input &input) {
       case SDL_KEYUP:
         event_to_input.TranslateKeyUp(sdl_event.key.keysym.scancode);
         break;
+      case SDL_WINDOWEVENT:
+        if (sdl_event.window.event == SDL_WINDOWEVENT_EXPOSED ||
+            sdl_event.window.event == SDL_WINDOWEVENT_SIZE_CHANGED)
+          window_exposed = true;
+        break;
+      case SDL_RENDER_TARGETS_RESET:
+        window_exposed = true;
+        break;
     }
   }
 
@@ -154,6 +167,21 @@ SDL_Texture *LoadTexture(std::string file) {
   return text;
 }
 
+/* An image as a surface in RGBA32, ready to copy into an atlas; nullptr on error */
+SDL_Surface *LoadSurface(std::string file) {
+  SDL_Surface *surf = IMG_Load(file.c_str());
+  if (!surf) {
+    std::cout << "loading img returned error" << std::endl;
+    return nullptr;
+  }
+  SDL_Surface *rgba = SDL_ConvertSurfaceFormat(surf, SDL_PIXELFORMAT_RGBA32, 0);
+  if (!rgba)
+    std::cout << "converting img failed error: " << SDL_GetError() << std::endl;
+
+  SDL_FreeSurface(surf);
+  return rgba;
+}
+
 /* Clear the view buffer, etc. */
 void StartDraw() {
   // SDL_FillRect(sdl_surface, NULL, SDL_MapRGB(sdl_surface->format, 0, 0, 0));
@@ -247,6 +275,192 @@ void DrawTexture(SDL_Texture *texture, v2d dest, v2d source, float h, float w, f
   );
 }
 
+/*
+ * Triangles queued up for a single SDL_RenderGeometry call, all
+ * sampling the same texture (or none). Building one of these per
+ * frame instead of issuing a draw call per shape keeps the number of
+ * calls down to a handful however many things are on screen.
+ */
+struct Batch {
+  SDL_Texture *texture = nullptr;
+  SDL_BlendMode blend = SDL_BLENDMODE_NONE;
+  std::vector<SDL_Vertex> vertices;
+  std::vector<int> indices;
+
+  void Clear() {
+    vertices.clear();
+    indices.clear();
+  }
+  /* Two triangles through corners p[0..3], in order round the quad */
+  void Quad(const v2d (&p)[4], const v2d (&uv)[4], SDL_Color color) {
+    int base = vertices.size();
+    for (int i = 0; i < 4; ++i)
+      vertices.push_back({ { p[i].x, p[i].y }, color, { uv[i].x, uv[i].y } });
+    for (int i : { 0, 1, 2, 0, 2, 3 })
+      indices.push_back(base + i);
+  }
+};
+
+/* Submit everything in the batch in one call, with its blend mode */
+void DrawBatch(const Batch &batch) {
+  if (batch.indices.empty()) return;
+  if (batch.texture)
+    SDL_SetTextureBlendMode(batch.texture, batch.blend);
+  else
+    SDL_SetRenderDrawBlendMode(sdl_renderer, batch.blend);
+  SDL_RenderGeometry(
+    sdl_renderer,
+    batch.texture,
+    batch.vertices.data(),
+    batch.vertices.size(),
+    batch.indices.data(),
+    batch.indices.size()
+  );
+}
+
+/* Whether textures can be drawn into with DrawBatchInto */
+bool TargetsSupported() {
+  return SDL_RenderTargetSupported(sdl_renderer);
+}
+
+/* A w by h texture that can be drawn into; nullptr on failure */
+SDL_Texture *CreateTarget(int w, int h) {
+  SDL_Texture *target = SDL_CreateTexture(
+    sdl_renderer, SDL_PIXELFORMAT_RGBA8888, SDL_TEXTUREACCESS_TARGET, w, h
+  );
+  if (!target)
+    std::cout << "creating render target failed error: " << SDL_GetError() << std::endl;
+  return target;
+}
+
+/* A transparent w by h texture for CopySurface to fill in */
+SDL_Texture *CreateAtlas(int w, int h) {
+  SDL_Texture *atlas = SDL_CreateTexture(
+    sdl_renderer, SDL_PIXELFORMAT_RGBA32, SDL_TEXTUREACCESS_STATIC, w, h
+  );
+  if (!atlas) {
+    std::cout << "creating atlas failed error: " << SDL_GetError() << std::endl;
+    return nullptr;
+  }
+  /* Static textures start out undefined; gaps between images must be clear */
+  std::vector<uint32_t> clear((size_t)w * h, 0);
+  SDL_UpdateTexture(atlas, nullptr, clear.data(), w * 4);
+  SDL_SetTextureBlendMode(atlas, SDL_BLENDMODE_BLEND);
+  return atlas;
+}
+
+/* Copy an RGBA32 surface into the texture with its top left at x, y */
+void CopySurface(SDL_Texture *texture, SDL_Surface *surf, int x, int y) {
+  SDL_Rect rect = { x, y, surf->w, surf->h };
+  if (SDL_UpdateTexture(texture, &rect, surf->pixels, surf->pitch) != 0)
+    std::cout << "copying into atlas failed error: " << SDL_GetError() << std::endl;
+}
+
+/*
+ * Drawing into a canvas, a target kept from frame to frame, instead
+ * of the window: StartCanvas, then ClearArea and draw for each part
+ * that changed, then ShowCanvas to put the whole thing on screen
+ */
+void StartCanvas(SDL_Texture *canvas) {
+  SDL_SetRenderTarget(sdl_renderer, canvas);
+}
+/* Keep drawing inside rect, and clear it to the background */
+void ClearArea(const SDL_Rect &rect) {
+  SDL_RenderSetClipRect(sdl_renderer, &rect);
+  SDL_SetRenderDrawBlendMode(sdl_renderer, SDL_BLENDMODE_NONE);
+  SDL_SetRenderDrawColor(sdl_renderer, 0, 0, 0, 255);
+  SDL_RenderFillRect(sdl_renderer, &rect);
+}
+void ShowCanvas(SDL_Texture *canvas) {
+  SDL_RenderSetClipRect(sdl_renderer, nullptr);
+  SDL_SetRenderTarget(sdl_renderer, nullptr);
+  SDL_RenderCopy(sdl_renderer, canvas, nullptr, nullptr);
+  SDL_RenderPresent(sdl_renderer);
+}
+
+/* Clear a target texture to transparent and draw the batch into it */
+void DrawBatchInto(SDL_Texture *target, const Batch &batch) {
+  SDL_SetRenderTarget(sdl_renderer, target);
+  SDL_SetRenderDrawColor(sdl_renderer, 0, 0, 0, 0);
+  SDL_RenderClear(sdl_renderer);
+  DrawBatch(batch);
+  SDL_SetRenderTarget(sdl_renderer, nullptr);
+}
+
+/*
+ * A 1px wide line from "from" to "to" as a quad, stretched half a
+ * pixel past each end so joined segments meet without a notch
+ */
+void BatchSegment(Batch &batch, v2d from, v2d to, SDL_Color color) {
+  v2d d = (to - from).Normalized() * 0.5;
+  /* A zero-length line still covers its pixel, like SDL_RenderDrawLine */
+  if (d.x == 0 && d.y == 0) d = { 0.5, 0.0 };
+  v2d n = { -d.y, d.x };
+  from -= d;
+  to += d;
+  const v2d uv[4] = {};
+  batch.Quad({ from + n, to + n, to - n, from - n }, uv, color);
+}
+
+/* Same shape as DrawRect(pos, side, corner), into a batch */
+void BatchRect(Batch &batch, v2d pos, float side, v2d corner, SDL_Color color) {
+  const float kRoot2 = 1.41421356;
+  float diag = side / 2.0 * kRoot2;
+  corner = corner.Normalized();
+  corner *= diag;
+
+  v2d perpen = { -corner.y, corner.x };
+  v2d pts[4] = { pos + corner, pos - perpen, pos - corner, pos + perpen };
+  for (int i = 0; i < 4; ++i)
+    BatchSegment(batch, pts[i], pts[(i + 1) % 4], color);
+}
+
+/* Size of the nub on the end of a ray, in pixels */
+const float kNibLength = 10.0;
+
+/* Same shape as DrawLine, into a batch */
+void BatchLine(Batch &batch, v2d pos, v2d ray, bool nub, SDL_Color color) {
+  v2d end = pos + ray;
+  BatchSegment(batch, pos, end, color);
+  if (!nub) return;
+
+  ray = ray.Normalized();
+  v2d tangent = { ray.y, -ray.x };
+  BatchSegment(batch, end, end - ray * kNibLength + tangent * kNibLength, color);
+}
+
+/*
+ * Same as DrawTexture, into a batch whose texture is tex_w by tex_h;
+ * theta turns it clockwise about its centre, in degrees, scale
+ * stretches it on screen, and the color tints it
+ */
+void BatchTexture(
+  Batch &batch, v2d dest, v2d source, float h, float w,
+  float tex_w, float tex_h, SDL_Color color, float theta = 0, float scale = 1
+) {
+  float u0 = source.x / tex_w, v0 = source.y / tex_h;
+  float u1 = (source.x + w) / tex_w, v1 = (source.y + h) / tex_h;
+  w *= scale;
+  h *= scale;
+  v2d corners[4] = {
+    dest, { dest.x + w, dest.y }, { dest.x + w, dest.y + h }, { dest.x, dest.y + h }
+  };
+  if (theta != 0) {
+    float rad = theta / 360.0 * 2.0 * 3.14159;
+    float c = std::cos(rad), s = std::sin(rad);
+    v2d mid = { dest.x + w / 2, dest.y + h / 2 };
+    for (v2d &p : corners) {
+      v2d d = { p.x - mid.x, p.y - mid.y };
+      p = { mid.x + d.x * c - d.y * s, mid.y + d.x * s + d.y * c };
+    }
+  }
+  batch.Quad(
+    { corners[0], corners[1], corners[2], corners[3] },
+    { { u0, v0 }, { u1, v0 }, { u1, v1 }, { u0, v1 } },
+    color
+  );
+}
+
 /* Get a random uint32_t using ticks since start */
 uint32_t Random() {
   return SDL_GetTicks();
@@ -0,0 +1,654 @@
+#ifndef SIMD_H
+#define SIMD_H
+
+#include <cstddef>
+#include <cstdint>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define SIMD_X86
+#include <immintrin.h>
+#endif
+
+/*
+ * Batch narrowphase kernels. Each one tests a single query shape
+ * against n colliders laid out column-wise (all x's, then all y's...),
+ * writes 1 or 0 to hit[i] for every collider and returns how many hit.
+ * Circles compare squared distances so there's no sqrt, and boxes are
+ * centers plus half extents, same as Collision::AabbAabb. A circle
+ * and a box overlap when the circle's center is closer than its
+ * radius to the nearest point of the box.
+ */
+namespace simd {
+
+/* Plain loops, used for the leftovers and on non-x86 machines */
+size_t CircleCircleScalar(
+  float qx, float qy, float qr,
+  const float *x, const float *y, const float *r,
+  size_t n, uint8_t *hit
+) {
+  size_t count = 0;
+  for (size_t i = 0; i < n; ++i) {
+    float dx = x[i] - qx;
+    float dy = y[i] - qy;
+    float s = r[i] + qr;
+    hit[i] = dx * dx + dy * dy < s * s;
+    count += hit[i];
+  }
+  return count;
+}
+
+size_t AabbAabbScalar(
+  float qx, float qy, float qw, float qh,
+  const float *x, const float *y, const float *w, const float *h,
+  size_t n, uint8_t *hit
+) {
+  size_t count = 0;
+  for (size_t i = 0; i < n; ++i) {
+    float dx = x[i] - qx;
+    float dy = y[i] - qy;
+    hit[i] = (dx < 0 ? -dx : dx) <= w[i] + qw && (dy < 0 ? -dy : dy) <= h[i] + qh;
+    count += hit[i];
+  }
+  return count;
+}
+
+/* A circle against boxes */
+size_t CircleAabbScalar(
+  float qx, float qy, float qr,
+  const float *x, const float *y, const float *w, const float *h,
+  size_t n, uint8_t *hit
+) {
+  size_t count = 0;
+  for (size_t i = 0; i < n; ++i) {
+    float dx = x[i] - qx;
+    float dy = y[i] - qy;
+    float ox = (dx < 0 ? -dx : dx) - w[i];
+    float oy = (dy < 0 ? -dy : dy) - h[i];
+    ox = ox < 0 ? 0 : ox;
+    oy = oy < 0 ? 0 : oy;
+    hit[i] = ox * ox + oy * oy < qr * qr;
+    count += hit[i];
+  }
+  return count;
+}
+
+/* A box against circles */
+size_t AabbCircleScalar(
+  float qx, float qy, float qw, float qh,
+  const float *x, const float *y, const float *r,
+  size_t n, uint8_t *hit
+) {
+  size_t count = 0;
+  for (size_t i = 0; i < n; ++i) {
+    float dx = x[i] - qx;
+    float dy = y[i] - qy;
+    float ox = (dx < 0 ? -dx : dx) - qw;
+    float oy = (dy < 0 ? -dy : dy) - qh;
+    ox = ox < 0 ? 0 : ox;
+    oy = oy < 0 ? 0 : oy;
+    hit[i] = ox * ox + oy * oy < r[i] * r[i];
+    count += hit[i];
+  }
+  return count;
+}
+
+/*
+ * Oriented boxes are a center, half extents along their own axes and
+ * the unit x axis (ux, uy); the y axis is that turned a quarter.
+ * Circles are tested in the box's frame, boxes against each other by
+ * separating axes: the two pairs of box axes are the only candidates.
+ */
+
+/* A circle against oriented boxes */
+size_t CircleObbScalar(
+  float qx, float qy, float qr,
+  const float *x, const float *y, const float *w, const float *h,
+  const float *ux, const float *uy,
+  size_t n, uint8_t *hit
+) {
+  size_t count = 0;
+  for (size_t i = 0; i < n; ++i) {
+    float dx = qx - x[i];
+    float dy = qy - y[i];
+    float lx = dx * ux[i] + dy * uy[i];
+    float ly = dy * ux[i] - dx * uy[i];
+    float ox = (lx < 0 ? -lx : lx) - w[i];
+    float oy = (ly < 0 ? -ly : ly) - h[i];
+    ox = ox < 0 ? 0 : ox;
+    oy = oy < 0 ? 0 : oy;
+    hit[i] = ox * ox + oy * oy < qr * qr;
+    count += hit[i];
+  }
+  return count;
+}
+
+/* An oriented box against circles */
+size_t ObbCircleScalar(
+  float qx, float qy, float qw, float qh, float qux, float quy,
+  const float *x, const float *y, const float *r,
+  size_t n, uint8_t *hit
+) {
+  size_t count = 0;
+  for (size_t i = 0; i < n; ++i) {
+    float dx = x[i] - qx;
+    float dy = y[i] - qy;
+    float lx = dx * qux + dy * quy;
+    float ly = dy * qux - dx * quy;
+    float ox = (lx < 0 ? -lx : lx) - qw;
+    float oy = (ly < 0 ? -ly : ly) - qh;
+    ox = ox < 0 ? 0 : ox;
+    oy = oy < 0 ? 0 : oy;
+    hit[i] = ox * ox + oy * oy < r[i] * r[i];
+    count += hit[i];
+  }
+  return count;
+}
+
+/* An oriented box against axis-aligned boxes */
+size_t ObbAabbScalar(
+  float qx, float qy, float qw, float qh, float qux, float quy,
+  const float *x, const float *y, const float *w, const float *h,
+  size_t n, uint8_t *hit
+) {
+  /* The query's extents along the world axes don't depend on i */
+  float c = qux < 0 ? -qux : qux, s = quy < 0 ? -quy : quy;
+  float ew = qw * c + qh * s, eh = qw * s + qh * c;
+  size_t count = 0;
+  for (size_t i = 0; i < n; ++i) {
+    float dx = x[i] - qx;
+    float dy = y[i] - qy;
+    float du = dx * qux + dy * quy;
+    float dv = dy * qux - dx * quy;
+    hit[i] = (dx < 0 ? -dx : dx) <= w[i] + ew &&
+             (dy < 0 ? -dy : dy) <= h[i] + eh &&
+             (du < 0 ? -du : du) <= qw + w[i] * c + h[i] * s &&
+             (dv < 0 ? -dv : dv) <= qh + w[i] * s + h[i] * c;
+    count += hit[i];
+  }
+  return count;
+}
+
+/* An oriented box against oriented boxes */
+size_t ObbObbScalar(
+  float qx, float qy, float qw, float qh, float qux, float quy,
+  const float *x, const float *y, const float *w, const float *h,
+  const float *ux, const float *uy,
+  size_t n, uint8_t *hit
+) {
+  size_t count = 0;
+  for (size_t i = 0; i < n; ++i) {
+    float dx = x[i] - qx;
+    float dy = y[i] - qy;
+    /* Cosine and sine of the angle between the two boxes */
+    float c = ux[i] * qux + uy[i] * quy;
+    float s = uy[i] * qux - ux[i] * quy;
+    c = c < 0 ? -c : c;
+    s = s < 0 ? -s : s;
+    float du = dx * qux + dy * quy;
+    float dv = dy * qux - dx * quy;
+    float di = dx * ux[i] + dy * uy[i];
+    float dj = dy * ux[i] - dx * uy[i];
+    hit[i] = (du < 0 ? -du : du) <= qw + w[i] * c + h[i] * s &&
+             (dv < 0 ? -dv : dv) <= qh + w[i] * s + h[i] * c &&
+             (di < 0 ? -di : di) <= w[i] + qw * c + qh * s &&
+             (dj < 0 ? -dj : dj) <= h[i] + qw * s + qh * c;
+    count += hit[i];
+  }
+  return count;
+}
+
+#ifdef SIMD_X86
+/* Spread a movemask out into one byte per lane */
+inline size_t Unpack(int bits, int lanes, uint8_t *hit) {
+  for (int l = 0; l < lanes; ++l)
+    hit[l] = (bits >> l) & 1;
+  return __builtin_popcount(bits);
+}
+
+__attribute__((target("sse2")))
+size_t CircleCircleSse2(
+  float qx, float qy, float qr,
+  const float *x, const float *y, const float *r,
+  size_t n, uint8_t *hit
+) {
+  __m128 vx = _mm_set1_ps(qx), vy = _mm_set1_ps(qy), vr = _mm_set1_ps(qr);
+  size_t count = 0, i = 0;
+  for (; i + 4 <= n; i += 4) {
+    __m128 dx = _mm_sub_ps(_mm_loadu_ps(x + i), vx);
+    __m128 dy = _mm_sub_ps(_mm_loadu_ps(y + i), vy);
+    __m128 s = _mm_add_ps(_mm_loadu_ps(r + i), vr);
+    __m128 d2 = _mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy));
+    count += Unpack(_mm_movemask_ps(_mm_cmplt_ps(d2, _mm_mul_ps(s, s))), 4, hit + i);
+  }
+  return count + CircleCircleScalar(qx, qy, qr, x + i, y + i, r + i, n - i, hit + i);
+}
+
+__attribute__((target("sse2")))
+size_t AabbAabbSse2(
+  float qx, float qy, float qw, float qh,
+  const float *x, const float *y, const float *w, const float *h,
+  size_t n, uint8_t *hit
+) {
+  __m128 vx = _mm_set1_ps(qx), vy = _mm_set1_ps(qy);
+  __m128 vw = _mm_set1_ps(qw), vh = _mm_set1_ps(qh);
+  /* Clearing the sign bit gives the absolute value */
+  __m128 abs = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+  size_t count = 0, i = 0;
+  for (; i + 4 <= n; i += 4) {
+    __m128 dx = _mm_and_ps(_mm_sub_ps(_mm_loadu_ps(x + i), vx), abs);
+    __m128 dy = _mm_and_ps(_mm_sub_ps(_mm_loadu_ps(y + i), vy), abs);
+    __m128 in_x = _mm_cmple_ps(dx, _mm_add_ps(_mm_loadu_ps(w + i), vw));
+    __m128 in_y = _mm_cmple_ps(dy, _mm_add_ps(_mm_loadu_ps(h + i), vh));
+    count += Unpack(_mm_movemask_ps(_mm_and_ps(in_x, in_y)), 4, hit + i);
+  }
+  return count + AabbAabbScalar(qx, qy, qw, qh, x + i, y + i, w + i, h + i, n - i, hit + i);
+}
+
+__attribute__((target("sse2")))
+size_t CircleAabbSse2(
+  float qx, float qy, float qr,
+  const float *x, const float *y, const float *w, const float *h,
+  size_t n, uint8_t *hit
+) {
+  __m128 vx = _mm_set1_ps(qx), vy = _mm_set1_ps(qy), vr = _mm_set1_ps(qr * qr);
+  __m128 abs = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+  __m128 zero = _mm_setzero_ps();
+  size_t count = 0, i = 0;
+  for (; i + 4 <= n; i += 4) {
+    __m128 dx = _mm_and_ps(_mm_sub_ps(_mm_loadu_ps(x + i), vx), abs);
+    __m128 dy = _mm_and_ps(_mm_sub_ps(_mm_loadu_ps(y + i), vy), abs);
+    __m128 ox = _mm_max_ps(_mm_sub_ps(dx, _mm_loadu_ps(w + i)), zero);
+    __m128 oy = _mm_max_ps(_mm_sub_ps(dy, _mm_loadu_ps(h + i)), zero);
+    __m128 d2 = _mm_add_ps(_mm_mul_ps(ox, ox), _mm_mul_ps(oy, oy));
+    count += Unpack(_mm_movemask_ps(_mm_cmplt_ps(d2, vr)), 4, hit + i);
+  }
+  return count + CircleAabbScalar(qx, qy, qr, x + i, y + i, w + i, h + i, n - i, hit + i);
+}
+
+__attribute__((target("sse2")))
+size_t AabbCircleSse2(
+  float qx, float qy, float qw, float qh,
+  const float *x, const float *y, const float *r,
+  size_t n, uint8_t *hit
+) {
+  __m128 vx = _mm_set1_ps(qx), vy = _mm_set1_ps(qy);
+  __m128 vw = _mm_set1_ps(qw), vh = _mm_set1_ps(qh);
+  __m128 abs = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+  __m128 zero = _mm_setzero_ps();
+  size_t count = 0, i = 0;
+  for (; i + 4 <= n; i += 4) {
+    __m128 dx = _mm_and_ps(_mm_sub_ps(_mm_loadu_ps(x + i), vx), abs);
+    __m128 dy = _mm_and_ps(_mm_sub_ps(_mm_loadu_ps(y + i), vy), abs);
+    __m128 ox = _mm_max_ps(_mm_sub_ps(dx, vw), zero);
+    __m128 oy = _mm_max_ps(_mm_sub_ps(dy, vh), zero);
+    __m128 d2 = _mm_add_ps(_mm_mul_ps(ox, ox), _mm_mul_ps(oy, oy));
+    __m128 s = _mm_loadu_ps(r + i);
+    count += Unpack(_mm_movemask_ps(_mm_cmplt_ps(d2, _mm_mul_ps(s, s))), 4, hit + i);
+  }
+  return count + AabbCircleScalar(qx, qy, qw, qh, x + i, y + i, r + i, n - i, hit + i);
+}
+
+__attribute__((target("sse2")))
+size_t CircleObbSse2(
+  float qx, float qy, float qr,
+  const float *x, const float *y, const float *w, const float *h,
+  const float *ux, const float *uy,
+  size_t n, uint8_t *hit
+) {
+  __m128 vx = _mm_set1_ps(qx), vy = _mm_set1_ps(qy), vr = _mm_set1_ps(qr * qr);
+  __m128 abs = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+  __m128 zero = _mm_setzero_ps();
+  size_t count = 0, i = 0;
+  for (; i + 4 <= n; i += 4) {
+    __m128 dx = _mm_sub_ps(vx, _mm_loadu_ps(x + i));
+    __m128 dy = _mm_sub_ps(vy, _mm_loadu_ps(y + i));
+    __m128 u = _mm_loadu_ps(ux + i), v = _mm_loadu_ps(uy + i);
+    __m128 lx = _mm_add_ps(_mm_mul_ps(dx, u), _mm_mul_ps(dy, v));
+    __m128 ly = _mm_sub_ps(_mm_mul_ps(dy, u), _mm_mul_ps(dx, v));
+    __m128 ox = _mm_max_ps(_mm_sub_ps(_mm_and_ps(lx, abs), _mm_loadu_ps(w + i)), zero);
+    __m128 oy = _mm_max_ps(_mm_sub_ps(_mm_and_ps(ly, abs), _mm_loadu_ps(h + i)), zero);
+    __m128 d2 = _mm_add_ps(_mm_mul_ps(ox, ox), _mm_mul_ps(oy, oy));
+    count += Unpack(_mm_movemask_ps(_mm_cmplt_ps(d2, vr)), 4, hit + i);
+  }
+  return count + CircleObbScalar(
+    qx, qy, qr, x + i, y + i, w + i, h + i, ux + i, uy + i, n - i, hit + i
+  );
+}
+
+__attribute__((target("sse2")))
+size_t ObbCircleSse2(
+  float qx, float qy, float qw, float qh, float qux, float quy,
+  const float *x, const float *y, const float *r,
+  size_t n, uint8_t *hit
+) {
+  __m128 vx = _mm_set1_ps(qx), vy = _mm_set1_ps(qy);
+  __m128 vw = _mm_set1_ps(qw), vh = _mm_set1_ps(qh);
+  __m128 u = _mm_set1_ps(qux), v = _mm_set1_ps(quy);
+  __m128 abs = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+  __m128 zero = _mm_setzero_ps();
+  size_t count = 0, i = 0;
+  for (; i + 4 <= n; i += 4) {
+    __m128 dx = _mm_sub_ps(_mm_loadu_ps(x + i), vx);
+    __m128 dy = _mm_sub_ps(_mm_loadu_ps(y + i), vy);
+    __m128 lx = _mm_add_ps(_mm_mul_ps(dx, u), _mm_mul_ps(dy, v));
+    __m128 ly = _mm_sub_ps(_mm_mul_ps(dy, u), _mm_mul_ps(dx, v));
+    __m128 ox = _mm_max_ps(_mm_sub_ps(_mm_and_ps(lx, abs), vw), zero);
+    __m128 oy = _mm_max_ps(_mm_sub_ps(_mm_and_ps(ly, abs), vh), zero);
+    __m128 d2 = _mm_add_ps(_mm_mul_ps(ox, ox), _mm_mul_ps(oy, oy));
+    __m128 s = _mm_loadu_ps(r + i);
+    count += Unpack(_mm_movemask_ps(_mm_cmplt_ps(d2, _mm_mul_ps(s, s))), 4, hit + i);
+  }
+  return count + ObbCircleScalar(qx, qy, qw, qh, qux, quy, x + i, y + i, r + i, n - i, hit + i);
+}
+
+__attribute__((target("sse2")))
+size_t ObbAabbSse2(
+  float qx, float qy, float qw, float qh, float qux, float quy,
+  const float *x, const float *y, const float *w, const float *h,
+  size_t n, uint8_t *hit
+) {
+  float ac = qux < 0 ? -qux : qux, as = quy < 0 ? -quy : quy;
+  __m128 vx = _mm_set1_ps(qx), vy = _mm_set1_ps(qy);
+  __m128 vw = _mm_set1_ps(qw), vh = _mm_set1_ps(qh);
+  __m128 ew = _mm_set1_ps(qw * ac + qh * as), eh = _mm_set1_ps(qw * as + qh * ac);
+  __m128 u = _mm_set1_ps(qux), v = _mm_set1_ps(quy);
+  __m128 c = _mm_set1_ps(ac), s = _mm_set1_ps(as);
+  __m128 abs = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+  size_t count = 0, i = 0;
+  for (; i + 4 <= n; i += 4) {
+    __m128 dx = _mm_sub_ps(_mm_loadu_ps(x + i), vx);
+    __m128 dy = _mm_sub_ps(_mm_loadu_ps(y + i), vy);
+    __m128 bw = _mm_loadu_ps(w + i), bh = _mm_loadu_ps(h + i);
+    __m128 du = _mm_add_ps(_mm_mul_ps(dx, u), _mm_mul_ps(dy, v));
+    __m128 dv = _mm_sub_ps(_mm_mul_ps(dy, u), _mm_mul_ps(dx, v));
+    __m128 in = _mm_cmple_ps(_mm_and_ps(dx, abs), _mm_add_ps(bw, ew));
+    in = _mm_and_ps(in, _mm_cmple_ps(_mm_and_ps(dy, abs), _mm_add_ps(bh, eh)));
+    __m128 ru = _mm_add_ps(vw, _mm_add_ps(_mm_mul_ps(bw, c), _mm_mul_ps(bh, s)));
+    __m128 rv = _mm_add_ps(vh, _mm_add_ps(_mm_mul_ps(bw, s), _mm_mul_ps(bh, c)));
+    in = _mm_and_ps(in, _mm_cmple_ps(_mm_and_ps(du, abs), ru));
+    in = _mm_and_ps(in, _mm_cmple_ps(_mm_and_ps(dv, abs), rv));
+    count += Unpack(_mm_movemask_ps(in), 4, hit + i);
+  }
+  return count + ObbAabbScalar(
+    qx, qy, qw, qh, qux, quy, x + i, y + i, w + i, h + i, n - i, hit + i
+  );
+}
+
+__attribute__((target("sse2")))
+size_t ObbObbSse2(
+  float qx, float qy, float qw, float qh, float qux, float quy,
+  const float *x, const float *y, const float *w, const float *h,
+  const float *ux, const float *uy,
+  size_t n, uint8_t *hit
+) {
+  __m128 vx = _mm_set1_ps(qx), vy = _mm_set1_ps(qy);
+  __m128 vw = _mm_set1_ps(qw), vh = _mm_set1_ps(qh);
+  __m128 u = _mm_set1_ps(qux), v = _mm_set1_ps(quy);
+  __m128 abs = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+  size_t count = 0, i = 0;
+  for (; i + 4 <= n; i += 4) {
+    __m128 dx = _mm_sub_ps(_mm_loadu_ps(x + i), vx);
+    __m128 dy = _mm_sub_ps(_mm_loadu_ps(y + i), vy);
+    __m128 bw = _mm_loadu_ps(w + i), bh = _mm_loadu_ps(h + i);
+    __m128 bu = _mm_loadu_ps(ux + i), bv = _mm_loadu_ps(uy + i);
+    __m128 c = _mm_and_ps(_mm_add_ps(_mm_mul_ps(bu, u), _mm_mul_ps(bv, v)), abs);
+    __m128 s = _mm_and_ps(_mm_sub_ps(_mm_mul_ps(bv, u), _mm_mul_ps(bu, v)), abs);
+    __m128 du = _mm_add_ps(_mm_mul_ps(dx, u), _mm_mul_ps(dy, v));
+    __m128 dv = _mm_sub_ps(_mm_mul_ps(dy, u), _mm_mul_ps(dx, v));
+    __m128 di = _mm_add_ps(_mm_mul_ps(dx, bu), _mm_mul_ps(dy, bv));
+    __m128 dj = _mm_sub_ps(_mm_mul_ps(dy, bu), _mm_mul_ps(dx, bv));
+    __m128 ru = _mm_add_ps(vw, _mm_add_ps(_mm_mul_ps(bw, c), _mm_mul_ps(bh, s)));
+    __m128 rv = _mm_add_ps(vh, _mm_add_ps(_mm_mul_ps(bw, s), _mm_mul_ps(bh, c)));
+    __m128 ri = _mm_add_ps(bw, _mm_add_ps(_mm_mul_ps(vw, c), _mm_mul_ps(vh, s)));
+    __m128 rj = _mm_add_ps(bh, _mm_add_ps(_mm_mul_ps(vw, s), _mm_mul_ps(vh, c)));
+    __m128 in = _mm_cmple_ps(_mm_and_ps(du, abs), ru);
+    in = _mm_and_ps(in, _mm_cmple_ps(_mm_and_ps(dv, abs), rv));
+    in = _mm_and_ps(in, _mm_cmple_ps(_mm_and_ps(di, abs), ri));
+    in = _mm_and_ps(in, _mm_cmple_ps(_mm_and_ps(dj, abs), rj));
+    count += Unpack(_mm_movemask_ps(in), 4, hit + i);
+  }
+  return count + ObbObbScalar(
+    qx, qy, qw, qh, qux, quy, x + i, y + i, w + i, h + i, ux + i, uy + i, n - i, hit + i
+  );
+}
+
+__attribute__((target("avx2")))
+size_t CircleCircleAvx2(
+  float qx, float qy, float qr,
+  const float *x, const float *y, const float *r,
+  size_t n, uint8_t *hit
+) {
+  __m256 vx = _mm256_set1_ps(qx), vy = _mm256_set1_ps(qy), vr = _mm256_set1_ps(qr);
+  size_t count = 0, i = 0;
+  for (; i + 8 <= n; i += 8) {
+    __m256 dx = _mm256_sub_ps(_mm256_loadu_ps(x + i), vx);
+    __m256 dy = _mm256_sub_ps(_mm256_loadu_ps(y + i), vy);
+    __m256 s = _mm256_add_ps(_mm256_loadu_ps(r + i), vr);
+    __m256 d2 = _mm256_add_ps(_mm256_mul_ps(dx, dx), _mm256_mul_ps(dy, dy));
+    __m256 lt = _mm256_cmp_ps(d2, _mm256_mul_ps(s, s), _CMP_LT_OQ);
+    count += Unpack(_mm256_movemask_ps(lt), 8, hit + i);
+  }
+  return count + CircleCircleSse2(qx, qy, qr, x + i, y + i, r + i, n - i, hit + i);
+}
+
+__attribute__((target("avx2")))
+size_t AabbAabbAvx2(
+  float qx, float qy, float qw, float qh,
+  const float *x, const float *y, const float *w, const float *h,
+  size_t n, uint8_t *hit
+) {
+  __m256 vx = _mm256_set1_ps(qx), vy = _mm256_set1_ps(qy);
+  __m256 vw = _mm256_set1_ps(qw), vh = _mm256_set1_ps(qh);
+  __m256 abs = _mm256_castsi256_ps(_mm256_set1_epi32(0x7fffffff));
+  size_t count = 0, i = 0;
+  for (; i + 8 <= n; i += 8) {
+    __m256 dx = _mm256_and_ps(_mm256_sub_ps(_mm256_loadu_ps(x + i), vx), abs);
+    __m256 dy = _mm256_and_ps(_mm256_sub_ps(_mm256_loadu_ps(y + i), vy), abs);
+    __m256 in_x = _mm256_cmp_ps(dx, _mm256_add_ps(_mm256_loadu_ps(w + i), vw), _CMP_LE_OQ);
+    __m256 in_y = _mm256_cmp_ps(dy, _mm256_add_ps(_mm256_loadu_ps(h + i), vh), _CMP_LE_OQ);
+    count += Unpack(_mm256_movemask_ps(_mm256_and_ps(in_x, in_y)), 8, hit + i);
+  }
+  return count + AabbAabbSse2(qx, qy, qw, qh, x + i, y + i, w + i, h + i, n - i, hit + i);
+}
+
+__attribute__((target("avx2")))
+size_t CircleAabbAvx2(
+  float qx, float qy, float qr,
+  const float *x, const float *y, const float *w, const float *h,
+  size_t n, uint8_t *hit
+) {
+  __m256 vx = _mm256_set1_ps(qx), vy = _mm256_set1_ps(qy), vr = _mm256_set1_ps(qr * qr);
+  __m256 abs = _mm256_castsi256_ps(_mm256_set1_epi32(0x7fffffff));
+  __m256 zero = _mm256_setzero_ps();
+  size_t count = 0, i = 0;
+  for (; i + 8 <= n; i += 8) {
+    __m256 dx = _mm256_and_ps(_mm256_sub_ps(_mm256_loadu_ps(x + i), vx), abs);
+    __m256 dy = _mm256_and_ps(_mm256_sub_ps(_mm256_loadu_ps(y + i), vy), abs);
+    __m256 ox = _mm256_max_ps(_mm256_sub_ps(dx, _mm256_loadu_ps(w + i)), zero);
+    __m256 oy = _mm256_max_ps(_mm256_sub_ps(dy, _mm256_loadu_ps(h + i)), zero);
+    __m256 d2 = _mm256_add_ps(_mm256_mul_ps(ox, ox), _mm256_mul_ps(oy, oy));
+    count += Unpack(_mm256_movemask_ps(_mm256_cmp_ps(d2, vr, _CMP_LT_OQ)), 8, hit + i);
+  }
+  return count + CircleAabbSse2(qx, qy, qr, x + i, y + i, w + i, h + i, n - i, hit + i);
+}
+
+__attribute__((target("avx2")))
+size_t AabbCircleAvx2(
+  float qx, float qy, float qw, float qh,
+  const float *x, const float *y, const float *r,
+  size_t n, uint8_t *hit
+) {
+  __m256 vx = _mm256_set1_ps(qx), vy = _mm256_set1_ps(qy);
+  __m256 vw = _mm256_set1_ps(qw), vh = _mm256_set1_ps(qh);
+  __m256 abs = _mm256_castsi256_ps(_mm256_set1_epi32(0x7fffffff));
+  __m256 zero = _mm256_setzero_ps();
+  size_t count = 0, i = 0;
+  for (; i + 8 <= n; i += 8) {
+    __m256 dx = _mm256_and_ps(_mm256_sub_ps(_mm256_loadu_ps(x + i), vx), abs);
+    __m256 dy = _mm256_and_ps(_mm256_sub_ps(_mm256_loadu_ps(y + i), vy), abs);
+    __m256 ox = _mm256_max_ps(_mm256_sub_ps(dx, vw), zero);
+    __m256 oy = _mm256_max_ps(_mm256_sub_ps(dy, vh), zero);
+    __m256 d2 = _mm256_add_ps(_mm256_mul_ps(ox, ox), _mm256_mul_ps(oy, oy));
+    __m256 s = _mm256_loadu_ps(r + i);
+    __m256 lt = _mm256_cmp_ps(d2, _mm256_mul_ps(s, s), _CMP_LT_OQ);
+    count += Unpack(_mm256_movemask_ps(lt), 8, hit + i);
+  }
+  return count + AabbCircleSse2(qx, qy, qw, qh, x + i, y + i, r + i, n - i, hit + i);
+}
+#endif
+
+typedef size_t (*CircleKernel)(
+  float, float, float,
+  const float *, const float *, const float *,
+  size_t, uint8_t *
+);
+typedef size_t (*AabbKernel)(
+  float, float, float, float,
+  const float *, const float *, const float *, const float *,
+  size_t, uint8_t *
+);
+typedef size_t (*CircleAabbKernel)(
+  float, float, float,
+  const float *, const float *, const float *, const float *,
+  size_t, uint8_t *
+);
+typedef size_t (*AabbCircleKernel)(
+  float, float, float, float,
+  const float *, const float *, const float *,
+  size_t, uint8_t *
+);
+typedef size_t (*CircleObbKernel)(
+  float, float, float,
+  const float *, const float *, const float *, const float *,
+  const float *, const float *,
+  size_t, uint8_t *
+);
+typedef size_t (*ObbCircleKernel)(
+  float, float, float, float, float, float,
+  const float *, const float *, const float *,
+  size_t, uint8_t *
+);
+typedef size_t (*ObbAabbKernel)(
+  float, float, float, float, float, float,
+  const float *, const float *, const float *, const float *,
+  size_t, uint8_t *
+);
+typedef size_t (*ObbObbKernel)(
+  float, float, float, float, float, float,
+  const float *, const float *, const float *, const float *,
+  const float *, const float *,
+  size_t, uint8_t *
+);
+
+struct Kernels {
+  CircleKernel circle_circle = CircleCircleScalar;
+  AabbKernel aabb_aabb = AabbAabbScalar;
+  CircleAabbKernel circle_aabb = CircleAabbScalar;
+  AabbCircleKernel aabb_circle = AabbCircleScalar;
+  /* Oriented boxes top out at SSE2 */
+  CircleObbKernel circle_obb = CircleObbScalar;
+  ObbCircleKernel obb_circle = ObbCircleScalar;
+  ObbAabbKernel obb_aabb = ObbAabbScalar;
+  ObbObbKernel obb_obb = ObbObbScalar;
+  const char *name = "scalar";
+};
+
+/* Pick the widest instruction set this CPU has, the first time through */
+const Kernels &Select() {
+  static const Kernels kernels = [] {
+    Kernels k;
+#ifdef SIMD_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("sse2")) {
+      k.circle_circle = CircleCircleSse2;
+      k.aabb_aabb = AabbAabbSse2;
+      k.circle_aabb = CircleAabbSse2;
+      k.aabb_circle = AabbCircleSse2;
+      k.circle_obb = CircleObbSse2;
+      k.obb_circle = ObbCircleSse2;
+      k.obb_aabb = ObbAabbSse2;
+      k.obb_obb = ObbObbSse2;
+      k.name = "sse2";
+    }
+    if (__builtin_cpu_supports("avx2")) {
+      k.circle_circle = CircleCircleAvx2;
+      k.aabb_aabb = AabbAabbAvx2;
+      k.circle_aabb = CircleAabbAvx2;
+      k.aabb_circle = AabbCircleAvx2;
+      k.name = "avx2";
+    }
+#endif
+    return k;
+  }();
+  return kernels;
+}
+
+size_t CircleCircle(
+  float qx, float qy, float qr,
+  const float *x, const float *y, const float *r,
+  size_t n, uint8_t *hit
+) {
+  return Select().circle_circle(qx, qy, qr, x, y, r, n, hit);
+}
+
+size_t AabbAabb(
+  float qx, float qy, float qw, float qh,
+  const float *x, const float *y, const float *w, const float *h,
+  size_t n, uint8_t *hit
+) {
+  return Select().aabb_aabb(qx, qy, qw, qh, x, y, w, h, n, hit);
+}
+
+size_t CircleAabb(
+  float qx, float qy, float qr,
+  const float *x, const float *y, const float *w, const float *h,
+  size_t n, uint8_t *hit
+) {
+  return Select().circle_aabb(qx, qy, qr, x, y, w, h, n, hit);
+}
+
+size_t AabbCircle(
+  float qx, float qy, float qw, float qh,
+  const float *x, const float *y, const float *r,
+  size_t n, uint8_t *hit
+) {
+  return Select().aabb_circle(qx, qy, qw, qh, x, y, r, n, hit);
+}
+
+size_t CircleObb(
+  float qx, float qy, float qr,
+  const float *x, const float *y, const float *w, const float *h,
+  const float *ux, const float *uy,
+  size_t n, uint8_t *hit
+) {
+  return Select().circle_obb(qx, qy, qr, x, y, w, h, ux, uy, n, hit);
+}
+
+size_t ObbCircle(
+  float qx, float qy, float qw, float qh, float qux, float quy,
+  const float *x, const float *y, const float *r,
+  size_t n, uint8_t *hit
+) {
+  return Select().obb_circle(qx, qy, qw, qh, qux, quy, x, y, r, n, hit);
+}
+
+size_t ObbAabb(
+  float qx, float qy, float qw, float qh, float qux, float quy,
+  const float *x, const float *y, const float *w, const float *h,
+  size_t n, uint8_t *hit
+) {
+  return Select().obb_aabb(qx, qy, qw, qh, qux, quy, x, y, w, h, n, hit);
+}
+
+size_t ObbObb(
+  float qx, float qy, float qw, float qh, float qux, float quy,
+  const float *x, const float *y, const float *w, const float *h,
+  const float *ux, const float *uy,
+  size_t n, uint8_t *hit
+) {
+  return Select().obb_obb(qx, qy, qw, qh, qux, quy, x, y, w, h, ux, uy, n, hit);
+}
+
+} // namespace simd
+
+#endif
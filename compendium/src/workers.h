@@ -0,0 +1,107 @@
+#ifndef WORKERS_H
+#define WORKERS_H
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/*
+ * Fixed pool of worker threads for chewing through a batch of
+ * independent jobs. Run() hands out job numbers until they're all
+ * taken, with the calling thread pitching in as worker 0, and only
+ * returns once every job is done.
+ */
+class WorkerPool {
+ public:
+  typedef std::function<void(size_t job, unsigned worker)> Job;
+
+  explicit WorkerPool(unsigned threads) {
+    for (unsigned t = 0; t < threads; ++t)
+      threads_.emplace_back([this, t] { Loop(t + 1); });
+  }
+  ~WorkerPool() {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      quit_ = true;
+    }
+    wake_.notify_all();
+    for (std::thread &t : threads_)
+      t.join();
+  }
+
+  /* Number of workers including the calling thread */
+  unsigned Size() const { return threads_.size() + 1; }
+
+  void Run(size_t jobs, const Job &fn) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    /* Stragglers from the last batch have to be out before we reset */
+    idle_.wait(lock, [&] { return active_ == 0; });
+    fn_ = &fn;
+    jobs_ = jobs;
+    next_ = 0;
+    pending_ = jobs;
+    ++batch_;
+    lock.unlock();
+    wake_.notify_all();
+
+    Work(0, fn, jobs);
+
+    lock.lock();
+    idle_.wait(lock, [&] { return pending_ == 0; });
+    fn_ = nullptr;
+  }
+
+ private:
+  void Loop(unsigned id) {
+    unsigned seen = 0;
+    for (;;) {
+      const Job *fn;
+      size_t jobs;
+      {
+        std::unique_lock<std::mutex> lock(mutex_);
+        wake_.wait(lock, [&] { return quit_ || batch_ != seen; });
+        if (quit_) return;
+        seen = batch_;
+        fn = fn_;
+        jobs = jobs_;
+        ++active_;
+      }
+      if (fn) Work(id, *fn, jobs);
+      {
+        std::lock_guard<std::mutex> lock(mutex_);
+        --active_;
+      }
+      idle_.notify_all();
+    }
+  }
+  void Work(unsigned id, const Job &fn, size_t jobs) {
+    for (;;) {
+      size_t j = next_.fetch_add(1);
+      if (j >= jobs) return;
+      fn(j, id);
+      if (pending_.fetch_sub(1) == 1) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        idle_.notify_all();
+      }
+    }
+  }
+
+  std::vector<std::thread> threads_;
+  std::mutex mutex_;
+  std::condition_variable wake_;
+  std::condition_variable idle_;
+  bool quit_ = false;
+  unsigned batch_ = 0;
+  /* Workers currently inside a batch */
+  unsigned active_ = 0;
+
+  const Job *fn_ = nullptr;
+  size_t jobs_ = 0;
+  std::atomic<size_t> next_{ 0 };
+  std::atomic<size_t> pending_{ 0 };
+}; // class WorkerPool
+
+#endif